@@ -0,0 +1,926 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+extern "C" {
+#include "tk_wordlist.h"
+}
+#include "tk_wordlist.hpp"
+
+/*
+Usage:
+./wordlist_bench datafiles/wordlist.dat datafiles/2of12inf.txt
+
+Compares lookups in the packed word list against the obvious alternatives
+on the same words, and checks they all agree. Returns nonzero if any of
+the lookups disagree with the plain word list, so this can be used to
+check a new pack before shipping it.
+
+Build with -DCMAKE_BUILD_TYPE=Release or the numbers don't mean much.
+*/
+
+// How many lookups in each workload
+#define NUM_QUERIES (200000)
+
+// How many times to run each workload, we keep the best
+#define NUM_ROUNDS (5)
+
+// How many of the queries get individually timed for the latency numbers
+#define NUM_LATENCY_SAMPLES (50000)
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double SecondsSince( BenchClock::time_point start )
+{
+    return std::chrono::duration<double>( BenchClock::now() - start ).count();
+}
+
+// Strip CR and newlines, also strip % which the word list uses to indicate
+// plurals, and any weight column. Same as wordtool does. Returns the weight.
+static u32 CleanLine( char *line )
+{
+    u32 weight = 0;
+    char *sep = strpbrk( line, " \t" );
+    if (sep) {
+        weight = (u32)strtoul( sep + 1, NULL, 10 );
+        *sep = '\0';
+    }
+    char *ch = line + strlen(line)-1;
+    while ((ch >= line) && ((*ch=='\n') || (*ch=='\r') || (*ch=='%') ) ) {
+        *ch = '\0';
+        ch--;
+    }
+    return weight;
+}
+
+// Duplicates keep the biggest weight, like wordtool
+static bool LoadWordList( const char *filename, std::vector<std::string> &words,
+                          std::unordered_map<std::string, u32> &weights )
+{
+    FILE *fp = fopen( filename, "rt" );
+    if (!fp) {
+        return false;
+    }
+    char line[1024];
+    while (fgets( line, sizeof(line), fp )) {
+        u32 weight = CleanLine( line );
+        if (line[0]) {
+            words.push_back( line );
+            u32 &best = weights[line];
+            best = std::max( best, weight );
+        }
+    }
+    fclose( fp );
+    return true;
+}
+
+// -----------------------------------------------------------------------
+// Workloads
+// -----------------------------------------------------------------------
+struct Workload {
+    const char *name;
+    std::vector<std::string> queries;
+    std::vector<const char *> queryPtrs;
+    std::vector<u8> expected;
+};
+
+// Make a word that's probably not in the list by changing a letter, or
+// adding one on the end. Anything that turns out to be a real word is skipped.
+static std::string MakeMiss( const std::string &word, std::mt19937 &rng )
+{
+    std::string miss = word;
+    int choice = rng() % 3;
+    char letter = 'a' + (rng() % 26);
+    if ((choice == 0) || (miss.size() < 2)) {
+        miss += letter;
+    } else if (choice == 1) {
+        miss[ rng() % miss.size() ] = letter;
+    } else {
+        miss.erase( miss.begin() + (rng() % miss.size()) );
+    }
+    return miss;
+}
+
+// Random letters, like garbage input. These are hardly ever words.
+static std::string MakeRandomString( std::mt19937 &rng )
+{
+    std::string str( 3 + (rng() % 10), 'a' );
+    for (size_t i=0; i < str.size(); i++) {
+        str[i] = 'a' + (rng() % 26);
+    }
+    return str;
+}
+
+static void MakeWorkload( Workload &work, const char *name, float hitFraction,
+                          const std::vector<std::string> &words,
+                          const std::unordered_set<std::string> &wordSet,
+                          std::mt19937 &rng, bool randomMisses = false )
+{
+    work.name = name;
+    while (work.queries.size() < NUM_QUERIES) {
+        const std::string &word = words[ rng() % words.size() ];
+        bool hit = (rng() % 1000) < (uint32_t)(hitFraction * 1000.0f);
+        std::string query = hit ? word : randomMisses ? MakeRandomString( rng ) : MakeMiss( word, rng );
+        if ((query.size() + 2 > MAX_WORD_LENGTH) || (!hit && wordSet.count( query ))) {
+            continue;
+        }
+        work.queries.push_back( query );
+        work.expected.push_back( hit ? 1 : 0 );
+    }
+    for (size_t i=0; i < work.queries.size(); i++) {
+        work.queryPtrs.push_back( work.queries[i].c_str() );
+    }
+}
+
+// -----------------------------------------------------------------------
+// The things we're comparing. Each one looks up a single word.
+// -----------------------------------------------------------------------
+struct BenchContext {
+    const WordList *wordlist;
+    WordListNode *worddata;     // NULL if the file isn't in the WordListNode struct format
+    tk::WordList<> tkWordList;  // not open if the file isn't in the default format
+    std::unordered_set<std::string> hashSet;
+    std::vector<const char *> sorted;
+    std::set<std::string> treeSet;
+    std::unordered_map<std::string, u32> weights;
+};
+
+static bool StrLess( const char *a, const char *b )
+{
+    return strcmp( a, b ) < 0;
+}
+
+static int Lookup_WordList( BenchContext &ctx, const char *word )
+{
+    return WordList_Lookup( ctx.worddata, (char *)word );
+}
+
+static int Lookup_WordListContains( BenchContext &ctx, const char *word )
+{
+    return WordList_Contains( ctx.wordlist, word );
+}
+
+static int Lookup_WordListFiltered( BenchContext &ctx, const char *word )
+{
+    return WordList_ContainsFiltered( ctx.wordlist, word );
+}
+
+static int Lookup_TkWordList( BenchContext &ctx, const char *word )
+{
+    return ctx.tkWordList.Contains( word ) ? 1 : 0;
+}
+
+static int Lookup_HashSet( BenchContext &ctx, const char *word )
+{
+    return ctx.hashSet.count( word ) ? 1 : 0;
+}
+
+static int Lookup_BinarySearch( BenchContext &ctx, const char *word )
+{
+    return std::binary_search( ctx.sorted.begin(), ctx.sorted.end(), word, StrLess ) ? 1 : 0;
+}
+
+static int Lookup_TreeSet( BenchContext &ctx, const char *word )
+{
+    return ctx.treeSet.count( word ) ? 1 : 0;
+}
+
+typedef int (*LookupFunc)( BenchContext &ctx, const char *word );
+
+struct LookupMethod {
+    const char *name;
+    LookupFunc lookup;
+};
+
+static const LookupMethod g_methods[] = {
+    { "WordList_Lookup", Lookup_WordList },
+    { "WordList_Contains", Lookup_WordListContains },
+    { "ContainsFiltered", Lookup_WordListFiltered },
+    { "tk::WordList<>", Lookup_TkWordList },
+    { "unordered_set", Lookup_HashSet },
+    { "binary search", Lookup_BinarySearch },
+    { "std::set", Lookup_TreeSet },
+};
+
+// -----------------------------------------------------------------------
+// Measurements
+// -----------------------------------------------------------------------
+static int g_errors = 0;
+
+static void CheckResult( const char *method, const Workload &work, size_t i, int result )
+{
+    if (result != work.expected[i]) {
+        if (g_errors < 10) {
+            printf("ERROR: %s says '%s' is %s\n", method, work.queries[i].c_str(),
+                   result ? "FOUND" : "Not Found" );
+        }
+        g_errors++;
+    }
+}
+
+static double Percentile( std::vector<double> &samples, double pct )
+{
+    size_t ndx = (size_t)(pct * (samples.size()-1));
+    std::nth_element( samples.begin(), samples.begin() + ndx, samples.end() );
+    return samples[ndx];
+}
+
+static void BenchLookups( BenchContext &ctx, const LookupMethod &method, const Workload &work )
+{
+    if ((method.lookup == Lookup_WordList) && (!ctx.worddata)) {
+        return;
+    }
+    if ((method.lookup == Lookup_TkWordList) && (!ctx.tkWordList.IsOpen())) {
+        return;
+    }
+    if ((method.lookup == Lookup_WordListFiltered) && (!ctx.wordlist->filter)) {
+        return;
+    }
+    double bestTime = 1e30;
+    for (int round=0; round < NUM_ROUNDS; round++) {
+        BenchClock::time_point start = BenchClock::now();
+        int found = 0;
+        for (size_t i=0; i < work.queries.size(); i++) {
+            found += method.lookup( ctx, work.queryPtrs[i] );
+        }
+        double elapsed = SecondsSince( start );
+        bestTime = std::min( bestTime, elapsed );
+
+        // Check the answers outside the timed loop
+        if (round == 0) {
+            for (size_t i=0; i < work.queries.size(); i++) {
+                CheckResult( method.name, work, i, method.lookup( ctx, work.queryPtrs[i] ) );
+            }
+        }
+    }
+
+    // Time some lookups one by one for the latency. The clock overhead is included
+    // in these, so compare them against each other rather than the throughput.
+    std::vector<double> samples;
+    samples.reserve( NUM_LATENCY_SAMPLES );
+    for (size_t i=0; i < NUM_LATENCY_SAMPLES; i++) {
+        const char *word = work.queryPtrs[ i % work.queries.size() ];
+        BenchClock::time_point start = BenchClock::now();
+        method.lookup( ctx, word );
+        samples.push_back( SecondsSince( start ) * 1e9 );
+    }
+    double p50 = Percentile( samples, 0.50 );
+    double p99 = Percentile( samples, 0.99 );
+
+    printf("  %-22s %8.2f M lookups/s   p50 %6.0f ns   p99 %6.0f ns\n",
+           method.name, (work.queries.size() / bestTime) / 1e6, p50, p99 );
+}
+
+static void BenchBatchLookups( BenchContext &ctx, const Workload &work )
+{
+    std::vector<u8> results( work.queries.size() );
+    double bestTime = 1e30;
+    for (int round=0; round < NUM_ROUNDS; round++) {
+        BenchClock::time_point start = BenchClock::now();
+        WordList_ContainsBatch( ctx.wordlist, (const char **)&work.queryPtrs[0],
+                                (int)work.queries.size(), &results[0] );
+        bestTime = std::min( bestTime, SecondsSince( start ) );
+    }
+    for (size_t i=0; i < work.queries.size(); i++) {
+        CheckResult( "WordList_ContainsBatch", work, i, results[i] );
+    }
+    printf("  %-22s %8.2f M lookups/s\n", "WordList_ContainsBatch",
+           (work.queries.size() / bestTime) / 1e6 );
+}
+
+// Counts the words in a range, and checks they're the next ones in the whole list
+struct RangeResult {
+    size_t count;
+    size_t mismatches;
+};
+
+static void EnumerateRange( WordList_Enumerator *enumerator, const std::vector<std::string> *expected,
+                            size_t first, RangeResult *result )
+{
+    char buffer[4096];
+    u8 lengths[256];
+    size_t count = 0, mismatches = 0;
+    int n;
+    while ((n = WordList_NextWords( enumerator, buffer, sizeof(buffer), lengths, 256 )) > 0) {
+        const char *word = buffer;
+        for (int i=0; i < n; i++) {
+            if (expected && ((first + count >= expected->size()) || ((*expected)[first + count] != word))) {
+                mismatches++;
+            }
+            count++;
+            word += lengths[i] + 1;
+        }
+    }
+    result->count = count;
+    result->mismatches = mismatches;
+}
+
+static void BenchEnumerate( BenchContext &ctx, size_t expectedWords )
+{
+    double bestTime = 1e30;
+    size_t count = 0;
+    for (int round=0; round < NUM_ROUNDS; round++) {
+        BenchClock::time_point start = BenchClock::now();
+        WordList_Enumerator ee = WordList_MakeListEnumerator( ctx.wordlist );
+        count = 0;
+        while (WordList_NextWord( &ee )) {
+            count++;
+        }
+        bestTime = std::min( bestTime, SecondsSince( start ) );
+    }
+    printf("  %-22s %8.2f M words/s (%zu words)\n", "WordList_NextWord",
+           (count / bestTime) / 1e6, count );
+
+    // The word list may have duplicates, and the packed list can have the
+    // last word twice, so only complain if we're missing words.
+    if (count < expectedWords) {
+        printf("ERROR: enumerated %zu words, expected at least %zu\n", count, expectedWords );
+        g_errors++;
+    }
+
+    std::vector<std::string> allWords;
+    WordList_Enumerator all = WordList_MakeListEnumerator( ctx.wordlist );
+    const char *word;
+    while ((word = WordList_NextWord( &all ))) {
+        allWords.push_back( word );
+    }
+
+    bestTime = 1e30;
+    RangeResult batch = {};
+    for (int round=0; round < NUM_ROUNDS; round++) {
+        BenchClock::time_point start = BenchClock::now();
+        WordList_Enumerator ee = WordList_MakeListEnumerator( ctx.wordlist );
+        EnumerateRange( &ee, NULL, 0, &batch );
+        bestTime = std::min( bestTime, SecondsSince( start ) );
+    }
+    printf("  %-22s %8.2f M words/s (%zu words)\n", "WordList_NextWords",
+           (batch.count / bestTime) / 1e6, batch.count );
+    if (batch.count != allWords.size()) {
+        printf("ERROR: batched enumeration got %zu words, expected %zu\n", batch.count, allWords.size() );
+        g_errors++;
+    }
+
+    // Split into ranges, one thread each. Check they cover the list exactly, in order.
+    int numThreads = std::max( 2, (int)std::thread::hardware_concurrency() );
+    std::vector<WordList_Enumerator> ranges( numThreads );
+    int numRanges = WordList_MakeRangeEnumerators( ctx.wordlist, &ranges[0], numThreads );
+    std::vector<RangeResult> results( numRanges );
+    size_t first = 0;
+    for (int r=0; r < numRanges; r++) {
+        WordList_Enumerator copy = ranges[r];
+        EnumerateRange( &copy, &allWords, first, &results[r] );
+        first += results[r].count;
+        if (results[r].mismatches) {
+            printf("ERROR: range %d of %d has %zu words out of place\n", r, numRanges, results[r].mismatches );
+            g_errors++;
+        }
+    }
+    if (first != allWords.size()) {
+        printf("ERROR: ranges got %zu words, expected %zu\n", first, allWords.size() );
+        g_errors++;
+    }
+
+    bestTime = 1e30;
+    for (int round=0; round < NUM_ROUNDS; round++) {
+        BenchClock::time_point start = BenchClock::now();
+        std::vector<WordList_Enumerator> copies( ranges );
+        std::vector<std::thread> threads;
+        for (int r=0; r < numRanges; r++) {
+            threads.push_back( std::thread( EnumerateRange, &copies[r], (const std::vector<std::string>*)NULL, 0, &results[r] ) );
+        }
+        for (size_t t=0; t < threads.size(); t++) {
+            threads[t].join();
+        }
+        bestTime = std::min( bestTime, SecondsSince( start ) );
+    }
+    char name[64];
+    snprintf( name, sizeof(name), "%d ranges", numRanges );
+    printf("  %-22s %8.2f M words/s\n", name, (allWords.size() / bestTime) / 1e6 );
+}
+
+// Crossword style patterns, made from some of the words with about half of the letters
+// blanked out, and a few with a '*'. Compared against checking every word in the list.
+#define NUM_PATTERNS (2000)
+
+static bool GlobMatch( const char *pattern, const char *word )
+{
+    if (*pattern == '*') {
+        return GlobMatch( pattern+1, word ) || (*word && GlobMatch( pattern, word+1 ));
+    }
+    if (!*pattern) {
+        return !*word;
+    }
+    return *word && ((*pattern == '?') || (*pattern == *word)) && GlobMatch( pattern+1, word+1 );
+}
+
+static int CountMatch( const char *, void *userData )
+{
+    (*(size_t*)userData)++;
+    return 1;
+}
+
+static void BenchPatternSet( BenchContext &ctx, const char *name, const std::vector<std::string> &patterns )
+{
+    std::vector<size_t> found( patterns.size() );
+    double bestTime = 1e30;
+    for (int round=0; round < NUM_ROUNDS; round++) {
+        BenchClock::time_point start = BenchClock::now();
+        for (size_t i=0; i < patterns.size(); i++) {
+            found[i] = 0;
+            WordList_MatchPattern( ctx.wordlist, patterns[i].c_str(), CountMatch, &found[i] );
+        }
+        bestTime = std::min( bestTime, SecondsSince( start ) );
+    }
+
+    // Just once, this is slow
+    BenchClock::time_point start = BenchClock::now();
+    for (size_t i=0; i < patterns.size(); i++) {
+        size_t expected = 0;
+        for (size_t w=0; w < ctx.sorted.size(); w++) {
+            expected += GlobMatch( patterns[i].c_str(), ctx.sorted[w] ) ? 1 : 0;
+        }
+        if (found[i] != expected) {
+            if (g_errors < 10) {
+                printf("ERROR: WordList_MatchPattern found %zu words for '%s', expected %zu\n",
+                       found[i], patterns[i].c_str(), expected );
+            }
+            g_errors++;
+        }
+    }
+    double scanTime = SecondsSince( start );
+    printf("  %-22s %8.2f us/pattern, scanning all words %8.2f us/pattern\n", name,
+           (bestTime / patterns.size()) * 1e6, (scanTime / patterns.size()) * 1e6 );
+}
+
+static void BenchPatterns( BenchContext &ctx, const Workload &work, std::mt19937 &rng )
+{
+    std::vector<std::string> fixedPatterns;
+    std::vector<std::string> starPatterns;
+    for (size_t i=0; fixedPatterns.size() + starPatterns.size() < NUM_PATTERNS; i++) {
+        std::string pattern = work.queries[i];
+        for (size_t c=0; c < pattern.size(); c++) {
+            if (rng() % 2) {
+                pattern[c] = '?';
+            }
+        }
+        if ((rng() % 10) == 0) {
+            pattern.replace( rng() % pattern.size(), 2, "*" );
+            starPatterns.push_back( pattern );
+        } else {
+            fixedPatterns.push_back( pattern );
+        }
+    }
+    BenchPatternSet( ctx, "fixed length", fixedPatterns );
+    BenchPatternSet( ctx, "with a '*'", starPatterns );
+}
+
+// Seven tile racks with scrabble-ish letter frequencies, with and without a blank
+#define NUM_RACKS (500)
+
+static bool RackCanMake( const char *word, const int *rackCounts, int blanks )
+{
+    int counts[26];
+    memcpy( counts, rackCounts, sizeof(counts) );
+    for (const char *ch = word; *ch; ch++) {
+        int letter = *ch - 'a';
+        if ((letter >= 0) && (letter < 26) && (counts[letter] > 0)) {
+            counts[letter]--;
+        } else if (blanks > 0) {
+            blanks--;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void BenchRacks( BenchContext &ctx, int blanks, std::mt19937 &rng )
+{
+    const char *tiles = "eeeeeeaaaaiiiiioooonnnnrrrrttttllssssuuddddgggbbccmmppffhhvvwwyykjxqz";
+    std::vector<std::string> racks;
+    for (int i=0; i < NUM_RACKS; i++) {
+        std::string rack;
+        for (int t=0; t < 7; t++) {
+            rack += tiles[ rng() % strlen( tiles ) ];
+        }
+        racks.push_back( rack );
+    }
+
+    std::vector<size_t> found( racks.size() );
+    double bestTime = 1e30;
+    for (int round=0; round < NUM_ROUNDS; round++) {
+        BenchClock::time_point start = BenchClock::now();
+        for (size_t i=0; i < racks.size(); i++) {
+            found[i] = 0;
+            WordList_FindFromRack( ctx.wordlist, racks[i].c_str(), blanks, CountMatch, &found[i] );
+        }
+        bestTime = std::min( bestTime, SecondsSince( start ) );
+    }
+
+    BenchClock::time_point start = BenchClock::now();
+    for (size_t i=0; i < racks.size(); i++) {
+        int counts[26] = {};
+        for (size_t t=0; t < racks[i].size(); t++) {
+            counts[ racks[i][t] - 'a' ]++;
+        }
+        size_t expected = 0;
+        for (size_t w=0; w < ctx.sorted.size(); w++) {
+            expected += RackCanMake( ctx.sorted[w], counts, blanks ) ? 1 : 0;
+        }
+        if (found[i] != expected) {
+            if (g_errors < 10) {
+                printf("ERROR: WordList_FindFromRack found %zu words for '%s' + %d blanks, expected %zu\n",
+                       found[i], racks[i].c_str(), blanks, expected );
+            }
+            g_errors++;
+        }
+    }
+    double scanTime = SecondsSince( start );
+    char name[32];
+    snprintf( name, sizeof(name), "%d blank%s", blanks, (blanks == 1) ? "" : "s" );
+    printf("  %-22s %8.2f us/rack, scanning all words %8.2f us/rack\n", name,
+           (bestTime / racks.size()) * 1e6, (scanTime / racks.size()) * 1e6 );
+}
+
+// Boggle style grids, on one thread and on a pool with a thread per core. A few of
+// the grids are checked by tracing every word in the list through them.
+#define NUM_GRIDS (200)
+#define NUM_CHECKED_GRIDS (10)
+
+static bool GridTrace( const std::string &grid, int width, int height, const char *word,
+                       int cell, std::vector<bool> &used )
+{
+    if (!*word) {
+        return true;
+    }
+    int x = cell % width;
+    int y = cell / width;
+    for (int ny = std::max( y-1, 0 ); ny <= std::min( y+1, height-1 ); ny++) {
+        for (int nx = std::max( x-1, 0 ); nx <= std::min( x+1, width-1 ); nx++) {
+            int next = ny * width + nx;
+            if ((!used[next]) && (grid[next] == *word)) {
+                used[next] = true;
+                bool found = GridTrace( grid, width, height, word+1, next, used );
+                used[next] = false;
+                if (found) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+static bool GridHasWord( const std::string &grid, int width, int height, const char *word )
+{
+    std::vector<bool> used( grid.size() );
+    for (int cell=0; cell < (int)grid.size(); cell++) {
+        if (grid[cell] == word[0]) {
+            used[cell] = true;
+            if (GridTrace( grid, width, height, word+1, cell, used )) {
+                return true;
+            }
+            used[cell] = false;
+        }
+    }
+    return false;
+}
+
+static void BenchGrids( BenchContext &ctx, WordList_ThreadPool *pool, int size, std::mt19937 &rng )
+{
+    const char *tiles = "eeeeeeaaaaiiiiioooonnnnrrrrttttllssssuuddddgggbbccmmppffhhvvwwyykjxqz";
+    std::vector<std::string> grids;
+    for (int i=0; i < NUM_GRIDS; i++) {
+        std::string grid;
+        for (int t=0; t < size*size; t++) {
+            grid += tiles[ rng() % strlen( tiles ) ];
+        }
+        grids.push_back( grid );
+    }
+
+    std::vector<size_t> found( grids.size() ), foundPool( grids.size() );
+    double bestTime = 1e30, bestPoolTime = 1e30;
+    for (int round=0; round < NUM_ROUNDS; round++) {
+        BenchClock::time_point start = BenchClock::now();
+        for (size_t i=0; i < grids.size(); i++) {
+            found[i] = 0;
+            WordList_SolveGrid( ctx.wordlist, NULL, grids[i].c_str(), size, size, CountMatch, &found[i] );
+        }
+        bestTime = std::min( bestTime, SecondsSince( start ) );
+
+        start = BenchClock::now();
+        for (size_t i=0; i < grids.size(); i++) {
+            foundPool[i] = 0;
+            WordList_SolveGrid( ctx.wordlist, pool, grids[i].c_str(), size, size, CountMatch, &foundPool[i] );
+        }
+        bestPoolTime = std::min( bestPoolTime, SecondsSince( start ) );
+    }
+
+    for (size_t i=0; i < grids.size(); i++) {
+        size_t expected = foundPool[i];
+        if (i < NUM_CHECKED_GRIDS) {
+            expected = 0;
+            for (size_t w=0; w < ctx.sorted.size(); w++) {
+                expected += GridHasWord( grids[i], size, size, ctx.sorted[w] ) ? 1 : 0;
+            }
+        }
+        if ((found[i] != expected) || (foundPool[i] != expected)) {
+            if (g_errors < 10) {
+                printf("ERROR: WordList_SolveGrid found %zu words (%zu with the pool) in %dx%d grid '%s', expected %zu\n",
+                       found[i], foundPool[i], size, size, grids[i].c_str(), expected );
+            }
+            g_errors++;
+        }
+    }
+    char name[32];
+    snprintf( name, sizeof(name), "%dx%d", size, size );
+    printf("  %-22s %8.2f us/grid, on the pool %8.2f us/grid\n", name,
+           (bestTime / grids.size()) * 1e6, (bestPoolTime / grids.size()) * 1e6 );
+}
+
+// Spelling suggestions for misspelled words, compared against working out the edit
+// distance to every word in the list
+#define NUM_FUZZY_QUERIES (200)
+
+static int EditDistance( const char *a, const char *b )
+{
+    int lenB = (int)strlen( b );
+    std::vector<int> row( lenB + 1 );
+    for (int j=0; j <= lenB; j++) {
+        row[j] = j;
+    }
+    for (const char *ch = a; *ch; ch++) {
+        int prev = row[0];
+        row[0]++;
+        for (int j=1; j <= lenB; j++) {
+            int d = std::min( std::min( row[j] + 1, row[j-1] + 1 ), prev + ((*ch == b[j-1]) ? 0 : 1) );
+            prev = row[j];
+            row[j] = d;
+        }
+    }
+    return row[lenB];
+}
+
+static int CountSimilar( const char *, int, void *userData )
+{
+    (*(size_t*)userData)++;
+    return 1;
+}
+
+static void BenchFuzzy( BenchContext &ctx, const Workload &work, int maxDistance )
+{
+    std::vector<const char *> queries( work.queryPtrs.begin(), work.queryPtrs.begin() + NUM_FUZZY_QUERIES );
+    std::vector<size_t> found( queries.size() );
+    double bestTime = 1e30;
+    for (int round=0; round < NUM_ROUNDS; round++) {
+        BenchClock::time_point start = BenchClock::now();
+        for (size_t i=0; i < queries.size(); i++) {
+            found[i] = 0;
+            WordList_FindSimilar( ctx.wordlist, queries[i], maxDistance, CountSimilar, &found[i] );
+        }
+        bestTime = std::min( bestTime, SecondsSince( start ) );
+    }
+
+    BenchClock::time_point start = BenchClock::now();
+    for (size_t i=0; i < queries.size(); i++) {
+        size_t expected = 0;
+        int queryLen = (int)strlen( queries[i] );
+        for (size_t w=0; w < ctx.sorted.size(); w++) {
+            if (abs( (int)strlen( ctx.sorted[w] ) - queryLen ) <= maxDistance) {
+                expected += (EditDistance( queries[i], ctx.sorted[w] ) <= maxDistance) ? 1 : 0;
+            }
+        }
+        if (found[i] != expected) {
+            if (g_errors < 10) {
+                printf("ERROR: WordList_FindSimilar found %zu words near '%s', expected %zu\n",
+                       found[i], queries[i], expected );
+            }
+            g_errors++;
+        }
+    }
+    double scanTime = SecondsSince( start );
+    char name[32];
+    snprintf( name, sizeof(name), "distance %d", maxDistance );
+    printf("  %-22s %8.2f us/word, scanning all words %8.2f us/word\n", name,
+           (bestTime / queries.size()) * 1e6, (scanTime / queries.size()) * 1e6 );
+}
+
+// IndexOf and WordAt should round trip, only if the file was packed with --word-index
+static void BenchWordIndex( BenchContext &ctx, const Workload &work )
+{
+    double bestTime = 1e30;
+    std::vector<int> indices( work.queries.size() );
+    for (int round=0; round < NUM_ROUNDS; round++) {
+        BenchClock::time_point start = BenchClock::now();
+        for (size_t i=0; i < work.queries.size(); i++) {
+            indices[i] = WordList_IndexOf( ctx.wordlist, work.queryPtrs[i] );
+        }
+        bestTime = std::min( bestTime, SecondsSince( start ) );
+    }
+    printf("  %-22s %8.2f M lookups/s\n", "WordList_IndexOf", (work.queries.size() / bestTime) / 1e6 );
+
+    char word[MAX_WORD_LENGTH];
+    bestTime = 1e30;
+    for (int round=0; round < NUM_ROUNDS; round++) {
+        BenchClock::time_point start = BenchClock::now();
+        for (size_t i=0; i < work.queries.size(); i++) {
+            WordList_WordAt( ctx.wordlist, (u32)indices[i], word );
+        }
+        bestTime = std::min( bestTime, SecondsSince( start ) );
+    }
+    printf("  %-22s %8.2f M lookups/s\n", "WordList_WordAt", (work.queries.size() / bestTime) / 1e6 );
+
+    for (size_t i=0; i < work.queries.size(); i++) {
+        if ((indices[i] < 0) || (!WordList_WordAt( ctx.wordlist, (u32)indices[i], word )) ||
+            (work.queries[i] != word)) {
+            if (g_errors < 10) {
+                printf("ERROR: word index doesn't round trip '%s' (%d)\n", work.queryPtrs[i], indices[i] );
+            }
+            g_errors++;
+        }
+    }
+}
+
+// Autocomplete on the first few letters of some of the words, like someone typing
+#define NUM_COMPLETE_RESULTS (10)
+
+// How many the check asks for from each letter
+#define NUM_COMPLETE_MANY_RESULTS (1000)
+
+// Higher weight first, then shorter words, like WordList_Complete
+static bool CompletionLess( const std::pair<u32, size_t> &a, const std::pair<u32, size_t> &b )
+{
+    return (a.first != b.first) ? (a.first > b.first) : (a.second < b.second);
+}
+
+// Results with the same weight and length can come in any order, so this only
+// checks each one has the weight and length the brute force one in its place has
+static void CheckComplete( BenchContext &ctx, const std::string &prefix,
+                           WordList_Completion *results, int maxResults )
+{
+    std::vector<std::pair<u32, size_t> > expected;
+    for (std::set<std::string>::iterator it = ctx.treeSet.lower_bound( prefix );
+         (it != ctx.treeSet.end()) && (!it->compare( 0, prefix.size(), prefix )); ++it) {
+        expected.push_back( std::make_pair( ctx.weights[*it], it->size() ) );
+    }
+    std::sort( expected.begin(), expected.end(), CompletionLess );
+
+    int n = WordList_Complete( ctx.wordlist, prefix.c_str(), results, maxResults );
+    int numExpected = (int)std::min<size_t>( expected.size(), maxResults );
+    if (n != numExpected) {
+        if (g_errors < 10) {
+            printf("ERROR: WordList_Complete found %d words for '%s', should be %d\n", n, prefix.c_str(), numExpected );
+        }
+        g_errors++;
+    }
+    std::unordered_set<std::string> seen;
+    for (int r=0; r < std::min( n, numExpected ); r++) {
+        std::unordered_map<std::string, u32>::iterator found = ctx.weights.find( results[r].word );
+        bool ok = (found != ctx.weights.end()) && (found->second == results[r].weight) &&
+                  (!strncmp( results[r].word, prefix.c_str(), prefix.size() )) &&
+                  (results[r].weight == expected[r].first) && (strlen( results[r].word ) == expected[r].second) &&
+                  seen.insert( results[r].word ).second;
+        if (!ok) {
+            if (g_errors < 10) {
+                printf("ERROR: WordList_Complete gave '%s' (%u) for '%s' result %d, should be weight %u length %zu\n",
+                       results[r].word, results[r].weight, prefix.c_str(), r, expected[r].first, expected[r].second );
+            }
+            g_errors++;
+        }
+    }
+}
+
+static void BenchComplete( BenchContext &ctx, const Workload &work )
+{
+    std::vector<std::string> prefixes;
+    for (size_t i=0; i < work.queries.size(); i += 10) {
+        const std::string &word = work.queries[i];
+        prefixes.push_back( word.substr( 0, 1 + (i/10) % std::min<size_t>( word.size(), 4 ) ) );
+    }
+
+    double bestTime = 1e30;
+    WordList_Completion results[NUM_COMPLETE_RESULTS];
+    for (int round=0; round < NUM_ROUNDS; round++) {
+        BenchClock::time_point start = BenchClock::now();
+        for (size_t i=0; i < prefixes.size(); i++) {
+            WordList_Complete( ctx.wordlist, prefixes[i].c_str(), results, NUM_COMPLETE_RESULTS );
+        }
+        bestTime = std::min( bestTime, SecondsSince( start ) );
+    }
+    printf("  %-22s %8.2f M queries/s (%d results each)\n", "WordList_Complete",
+           (prefixes.size() / bestTime) / 1e6, NUM_COMPLETE_RESULTS );
+
+    // Check against a brute force top K, and ask for lots from each letter so
+    // the search has to queue up far more nodes than fit on the stack
+    std::vector<WordList_Completion> manyResults( NUM_COMPLETE_MANY_RESULTS );
+    for (size_t i=0; i < prefixes.size(); i++) {
+        CheckComplete( ctx, prefixes[i], results, NUM_COMPLETE_RESULTS );
+    }
+    for (char letter='a'; letter <= 'z'; letter++) {
+        CheckComplete( ctx, std::string( 1, letter ), &manyResults[0], NUM_COMPLETE_MANY_RESULTS );
+    }
+}
+
+// ======================================================================
+// Bench main
+// ======================================================================
+int main( int argc, char *argv[] )
+{
+    if (argc < 3) {
+        printf("Usage: wordlist_bench <wordlist.dat> <wordlist.txt>\n");
+        return 1;
+    }
+
+    WordList wordlist;
+    if (!WordList_Open( &wordlist, argv[1] )) {
+        printf("ERROR: Couldn't open word data file '%s': %s\n", argv[1], wordlist.error );
+        return 1;
+    }
+    if (!WordList_Verify( &wordlist )) {
+        printf("ERROR: Checksum doesn't match for '%s'\n", argv[1] );
+        return 1;
+    }
+    BenchContext ctx;
+    ctx.wordlist = &wordlist;
+    ctx.worddata = wordlist.nodes;
+    ctx.tkWordList.Open( wordlist );
+
+    std::vector<std::string> words;
+    if (!LoadWordList( argv[2], words, ctx.weights )) {
+        printf("ERROR: Couldn't open word list '%s'\n", argv[2] );
+        return 1;
+    }
+
+    ctx.hashSet.insert( words.begin(), words.end() );
+    ctx.treeSet.insert( words.begin(), words.end() );
+    for (std::set<std::string>::iterator it = ctx.treeSet.begin(); it != ctx.treeSet.end(); ++it) {
+        ctx.sorted.push_back( it->c_str() );
+    }
+    printf("%zu words (%zu unique)\n", words.size(), ctx.treeSet.size() );
+
+    std::mt19937 rng( 12345 );
+    Workload workloads[4];
+    MakeWorkload( workloads[0], "hit-heavy (100% hits)", 1.0f, words, ctx.hashSet, rng );
+    MakeWorkload( workloads[1], "miss-heavy (10% hits)", 0.1f, words, ctx.hashSet, rng );
+    MakeWorkload( workloads[2], "mixed (50% hits)", 0.5f, words, ctx.hashSet, rng );
+    MakeWorkload( workloads[3], "random strings (10% hits)", 0.1f, words, ctx.hashSet, rng, true );
+
+    for (int w=0; w < 4; w++) {
+        printf("\n%s, %zu queries:\n", workloads[w].name, workloads[w].queries.size() );
+        for (size_t m=0; m < sizeof(g_methods) / sizeof(g_methods[0]); m++) {
+            BenchLookups( ctx, g_methods[m], workloads[w] );
+        }
+        BenchBatchLookups( ctx, workloads[w] );
+    }
+
+    printf("\nenumeration:\n");
+    BenchEnumerate( ctx, ctx.treeSet.size() );
+
+    printf("\npatterns:\n");
+    BenchPatterns( ctx, workloads[0], rng );
+
+    printf("\nracks:\n");
+    BenchRacks( ctx, 0, rng );
+    BenchRacks( ctx, 1, rng );
+
+    printf("\ngrids:\n");
+    WordList_ThreadPool *pool = WordList_CreateThreadPool( 0 );
+    if (!pool) {
+        printf("ERROR: Couldn't start the thread pool\n");
+        return 1;
+    }
+    BenchGrids( ctx, pool, 4, rng );
+    BenchGrids( ctx, pool, 8, rng );
+    WordList_DestroyThreadPool( pool );
+
+    printf("\nspelling suggestions:\n");
+    BenchFuzzy( ctx, workloads[1], 1 );
+    BenchFuzzy( ctx, workloads[1], 2 );
+
+    printf("\nautocomplete:\n");
+    BenchComplete( ctx, workloads[0] );
+
+    if (wordlist.wordCounts) {
+        printf("\nword index:\n");
+        BenchWordIndex( ctx, workloads[0] );
+    }
+    WordList_Close( &wordlist );
+
+    if (g_errors) {
+        printf("\nFAILED: %d errors\n", g_errors );
+        return 1;
+    }
+    printf("\nOK\n");
+    return 0;
+}
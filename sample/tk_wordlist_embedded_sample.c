@@ -0,0 +1,32 @@
+
+#include "tk_wordlist.h"
+
+#include <stdio.h>
+
+/* ---------------------------------------------------------
+   The word list is packed at build time and linked into the
+   program, see tk_wordlist_embed in sample/CMakeLists.txt.
+   Opening it just checks the header, there's no file to
+   read so this is as quick to start as a program can be.
+--------------------------------------------------------- */
+WORDLIST_EMBEDDED( embedded_words );
+
+int main( int argc, char *argv[] )
+{
+	if (argc<2) {
+		printf("Usage: tk_wordlist_embedded_sample <word> [more words...]\n");
+		return 1;
+	}
+
+	WordList wordlist;
+	if (!WordList_OpenMemory( &wordlist, embedded_words, embedded_words_size )) {
+		printf("Built in word list is broken: %s\n", wordlist.error );
+		return 1;
+	}
+
+	for (int i=1; i < argc; i++) {
+		int result = WordList_Contains( &wordlist, argv[i] );
+		printf("%20s ... %s\n", argv[i], result?"FOUND":"Not Found" );
+	}
+	return 0;
+}
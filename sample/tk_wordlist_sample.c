@@ -7,10 +7,10 @@
 
 /* ---------------------------------------------------------
    Example of how to lookup words to see if they are in the
-   dictionary. WordList_Lookup returns 1 if the word is
+   dictionary. WordList_Contains returns 1 if the word is
    included, 0 if not.
 --------------------------------------------------------- */
-void LookupSomeWords( WordListNode *worddata )
+void LookupSomeWords( const WordList *wordlist )
 {
 	// Test some lookups
     const char *testWords[] = {
@@ -20,17 +20,194 @@ void LookupSomeWords( WordListNode *worddata )
     };
     for (int i=0; i < sizeof(testWords) / sizeof(testWords[0]); i++ ) {
         
-        int result = WordList_Lookup( worddata, (char *)testWords[i] );
+        int result = WordList_Contains( wordlist, testWords[i] );
 
         printf("%20s ... %s\n", testWords[i], result?"FOUND":"Not Found" );
     }
+
+    // Or check them all at once, this is faster for big lists that don't fit in the cache
+    int numWords = sizeof(testWords) / sizeof(testWords[0]);
+    u8 results[sizeof(testWords) / sizeof(testWords[0])];
+    WordList_ContainsBatch( wordlist, testWords, numWords, results );
+
+    int numFound = 0;
+    for (int i=0; i < numWords; i++ ) {
+        numFound += results[i];
+    }
+    printf("Batch lookup found %d of %d words\n", numFound, numWords );
+
+    // If it was packed with --filter, this turns away most non-words without
+    // going down the trie. Otherwise it's the same as WordList_Contains.
+    printf("%20s ... %s\n", "qxzzkrv", WordList_ContainsFiltered( wordlist, "qxzzkrv" )?"FOUND":"Not Found" );
+}
+/* ---------------------------------------------------------
+   Example of autocomplete, finds the best few words that
+   start with some letters. If the word list was packed with
+   weights these come highest weight first.
+--------------------------------------------------------- */
+void CompleteSomeWords( const WordList *wordlist )
+{
+	const char *prefixes[] = { "tea", "scala", "zyg", "qwx" };
+	for (int i=0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++ ) {
+		WordList_Completion completions[5];
+		int count = WordList_Complete( wordlist, prefixes[i], completions, 5 );
+		printf("%20s ...", prefixes[i] );
+		for (int c=0; c < count; c++) {
+			printf(" %s", completions[c].word );
+		}
+		printf("%s\n", count ? "" : " nothing" );
+	}
+}
+
+/* ---------------------------------------------------------
+   Example of a crossword style pattern search, '?' matches
+   any letter and '*' matches any number of letters.
+--------------------------------------------------------- */
+int PrintMatch( const char *word, void *userData )
+{
+	int *count = (int*)userData;
+	if ((*count)++ < 8) {
+		printf(" %s", word );
+	}
+	return 1;
+}
+
+void MatchSomePatterns( const WordList *wordlist )
+{
+	const char *patterns[] = { "c?t", "?a??le", "re*ing", "q??" };
+	for (int i=0; i < sizeof(patterns) / sizeof(patterns[0]); i++ ) {
+		int count = 0;
+		printf("%20s ...", patterns[i] );
+		WordList_MatchPattern( wordlist, patterns[i], PrintMatch, &count );
+		printf("%s (%d words)\n", (count > 8) ? " ..." : "", count );
+	}
+}
+
+/* ---------------------------------------------------------
+   Example of finding the words you can make with a rack of
+   tiles. Letters that used a blank tile are upper case.
+--------------------------------------------------------- */
+void FindSomeRacks( const WordList *wordlist )
+{
+	const char *racks[] = { "qzixu", "retains", "rhythm" };
+	int blanks[] = { 1, 0, 0 };
+	for (int i=0; i < sizeof(racks) / sizeof(racks[0]); i++ ) {
+		int count = 0;
+		printf("%18s+%d ...", racks[i], blanks[i] );
+		WordList_FindFromRack( wordlist, racks[i], blanks[i], PrintMatch, &count );
+		printf("%s (%d words)\n", (count > 8) ? " ..." : "", count );
+	}
+}
+
+/* ---------------------------------------------------------
+   Example of finding all the words in a Boggle grid. The
+   pool is usually made once and kept around.
+--------------------------------------------------------- */
+void SolveSomeGrid( const WordList *wordlist )
+{
+	const char *grid = "serslinatedrpeoa";
+	WordList_ThreadPool *pool = WordList_CreateThreadPool( 0 );
+	int count = 0;
+	printf("%20s ...", grid );
+	WordList_SolveGrid( wordlist, pool, grid, 4, 4, PrintMatch, &count );
+	printf("%s (%d words)\n", (count > 8) ? " ..." : "", count );
+	WordList_DestroyThreadPool( pool );
+}
+
+/* ---------------------------------------------------------
+   Example of spelling suggestions for some misspelled words
+--------------------------------------------------------- */
+void SuggestSomeWords( const WordList *wordlist )
+{
+	const char *misspelled[] = { "recieve", "wierd", "acommodate", "teh" };
+	for (int i=0; i < sizeof(misspelled) / sizeof(misspelled[0]); i++ ) {
+		WordList_Suggestion suggestions[5];
+		int count = WordList_Suggest( wordlist, misspelled[i], 2, suggestions, 5 );
+		printf("%20s ...", misspelled[i] );
+		for (int s=0; s < count; s++) {
+			printf(" %s(%d)", suggestions[s].word, suggestions[s].distance );
+		}
+		printf("\n");
+	}
+}
+
+/* ---------------------------------------------------------
+   Example of the word index, each word gets a number that
+   can index your own arrays. Only works if the list was
+   packed with "wordtool --word-index".
+--------------------------------------------------------- */
+void IndexSomeWords( const WordList *wordlist )
+{
+	if (!wordlist->wordCounts) {
+		printf("No word index, pack with --word-index to try it\n");
+		return;
+	}
+	const char *testWords[] = { "aardvark", "scalawag", "zymurgy", "blarg" };
+	for (int i=0; i < sizeof(testWords) / sizeof(testWords[0]); i++ ) {
+		int index = WordList_IndexOf( wordlist, testWords[i] );
+		char word[MAX_WORD_LENGTH] = "";
+		if (index >= 0) {
+			WordList_WordAt( wordlist, index, word );
+		}
+		printf("%20s ... index %d (%s)\n", testWords[i], index, word );
+	}
+}
+
+/* ---------------------------------------------------------
+   Example of adding and removing words without repacking.
+   WordList_OverlaySave writes the changed list out for
+   wordtool --sorted when it's time to fold them in.
+--------------------------------------------------------- */
+void ChangeSomeWords( const WordList *wordlist )
+{
+	WordList_Overlay *overlay = WordList_CreateOverlay( wordlist );
+	if (!overlay) {
+		return;
+	}
+	WordList_OverlayAdd( overlay, "blarg" );
+	WordList_OverlayAdd( overlay, "zyzzyva" );
+	WordList_OverlayRemove( overlay, "teams" );
+
+	const char *testWords[] = { "blarg", "teams", "team" };
+	for (int i=0; i < sizeof(testWords) / sizeof(testWords[0]); i++ ) {
+		int result = WordList_OverlayContains( overlay, testWords[i] );
+		printf("%20s ... %s\n", testWords[i], result?"FOUND":"Not Found" );
+	}
+	printf("%u words with %d changes\n", WordList_OverlayNumWords( overlay ), WordList_OverlayNumChanges( overlay ) );
+	WordList_DestroyOverlay( overlay );
 }
+
+/* ---------------------------------------------------------
+   Example of splitting the word list into ranges, these
+   could each be enumerated on a different thread. This
+   gets the words in batches, which is faster.
+--------------------------------------------------------- */
+void SplitIntoRanges( const WordList *wordlist )
+{
+	WordList_Enumerator ranges[4];
+	int numRanges = WordList_MakeRangeEnumerators( wordlist, ranges, 4 );
+	for (int r=0; r < numRanges; r++) {
+		char buffer[1024];
+		u8 lengths[64];
+		char firstWord[MAX_WORD_LENGTH] = "";
+		int count = 0;
+		int n;
+		while ((n = WordList_NextWords( &ranges[r], buffer, sizeof(buffer), lengths, 64 )) > 0) {
+			if (!count) {
+				strcpy( firstWord, buffer );
+			}
+			count += n;
+		}
+		printf("Range %d starts at '%s', %d words\n", r, firstWord, count );
+	}
+}
+
 /* ---------------------------------------------------------
   Example of enumerating al the words in the word list
 --------------------------------------------------------- */
-void GatherWordStats( WordListNode *worddata )
+void GatherWordStats( const WordList *wordlist )
 {
-	WordList_Enumerator ee = WordList_MakeEnumerator( worddata );
+	WordList_Enumerator ee = WordList_MakeListEnumerator( wordlist );
 
 	int longestWordLen =0;
 	char longestWord[MAX_WORD_LENGTH];
@@ -100,34 +277,28 @@ int main( int argc, char *argv[] )
 		return 1;		
 	}
 
-	// Read word data file
-	FILE *fp = fopen(argv[1], "rb");
-	if (!fp) {
-		printf("Couldn't open word data file '%s'\n", argv[1] );
+	// Map the word data file, this just checks the header so it's
+	// quick no matter how big the word list is.
+	WordList wordlist;
+	if (!WordList_Open( &wordlist, argv[1] )) {
+		printf("Couldn't open word data file '%s': %s\n", argv[1], wordlist.error );
 		return 1;
 	}
-
-	// Get file size
-    fseek( fp, 0L, SEEK_END );
-    size_t filesz = ftell(fp);
-    fseek( fp, 0L, SEEK_SET );
-
-    // Allocate space for word data
-    WordListNode *worddata = (WordListNode*)malloc( filesz );            
-    if (!worddata) {
-    	printf("Couldn't allocate word data.\n");
-    	return 1;
-    }
-
-    // Load the word data
-    size_t result = fread( worddata, filesz, 1, fp );
-    if (!result) {
-    	printf("Couldn't read data from '%s'\n", argv[1] );
-    	return 1;
-    }
+	printf("%s: %u words, %u nodes, %u byte edge indices\n", argv[1],
+		wordlist.numWords, wordlist.numNodes, wordlist.format.edgeIndexSize );
 
     // Use the word data for things...
-	LookupSomeWords( worddata );
-	GatherWordStats( worddata );
+	LookupSomeWords( &wordlist );
+	CompleteSomeWords( &wordlist );
+	MatchSomePatterns( &wordlist );
+	FindSomeRacks( &wordlist );
+	SolveSomeGrid( &wordlist );
+	SuggestSomeWords( &wordlist );
+	IndexSomeWords( &wordlist );
+	ChangeSomeWords( &wordlist );
+	SplitIntoRanges( &wordlist );
+	GatherWordStats( &wordlist );
 
+	WordList_Close( &wordlist );
+	return 0;
 }
\ No newline at end of file
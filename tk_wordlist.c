@@ -5,95 +5,3020 @@
 // TODO: Remove dependenacies on string.h and stdlib.h, don't really need these
 // TODO: Make actually a single-header file...
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
 #include "tk_wordlist.h"
 
 
-static int WordList_StartsWith( const char *prefix, const char *str )
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define WORDLIST_SIMD_X86 (1)
+#include <immintrin.h>
+#define WORDLIST_TARGET(isa) __attribute__((target(isa)))
+#define WORDLIST_CTZ(x) __builtin_ctz(x)
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define WORDLIST_SIMD_X86 (1)
+#include <immintrin.h>
+#include <intrin.h>
+#define WORDLIST_TARGET(isa)
+static int WORDLIST_CTZ( unsigned long x ) { unsigned long ndx; _BitScanForward( &ndx, x ); return (int)ndx; }
+#else
+#define WORDLIST_SIMD_X86 (0)
+#endif
+
+// -----------------------------------------------------------------------
+// Edge matching
+//
+// Labels are compared four bytes at a time as u32s. A label matches the target
+// if every byte of the label is either equal to the target byte or is the nul
+// padding at the end of the label. Labels never contain a nul in the middle so
+// this is the same as checking that the target starts with the label.
+// -----------------------------------------------------------------------
+
+// Enough room for a u8 numEdges plus padding for the widest vector
+#define WORDLIST_MAX_LABELS (256 + 8)
+
+// Returns the index of the first label that matches, or -1
+typedef int (*WordList_MatchEdgesFunc)( const u32 *labels, int count, u32 target );
+
+static u32 WordList_LoadLabel( const char *label )
 {
-    int prefixLen = strnlen( prefix, 4 );
-    return strncmp( prefix, str, prefixLen ) == 0;
+    u32 result;
+    memcpy( &result, label, 4 );
+    return result;
 }
 
-static int WordList_LookupImpl( WordListNode *base, WordListNode *curr, char *target)
+// Load the next four bytes of the target, without reading past the nul
+static u32 WordList_LoadTarget( const char *target )
 {
-    
-    //printf("target %s curr->label '%s'\n", target, curr->label );
-    target = target + strnlen( curr->label, 4 );
-    //printf("target after '%s' strnlen() %d\n", target, strnlen( curr->label, 4) );
-    if (*target==0) {
-        return 1; // Found the whole string
+    char buff[4] = {0};
+    for (int i=0; (i < 4) && target[i]; i++) {
+        buff[i] = target[i];
     }
-    
-    for (int i=0; i < curr->numEdges; i++) {
-        int ndx = curr->edge[i];
-        WordListNode *edgeNode = base + ndx;
-        char buff[5] = {};
-        strncpy( buff, edgeNode->label, 4 );
-        //printf("Check Edge '%s', '%s'\n", buff, target );
+    return WordList_LoadLabel( buff );
+}
+
+static int WordList_MatchEdgesScalar( const u32 *labels, int count, u32 target )
+{
+    for (int i=0; i < count; i++) {
+        const u8 *label = (const u8*)&labels[i];
+        const u8 *targ = (const u8*)&target;
+        int match = 1;
+        for (int j=0; j < 4; j++) {
+            if ((label[j] != 0) && (label[j] != targ[j])) {
+                match = 0;
+                break;
+            }
+        }
+        if (match) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#if WORDLIST_SIMD_X86
+WORDLIST_TARGET("sse2")
+static int WordList_MatchEdgesSSE2( const u32 *labels, int count, u32 target )
+{
+    __m128i targ = _mm_set1_epi32( (int)target );
+    __m128i zero = _mm_setzero_si128();
+    __m128i ones = _mm_set1_epi32( -1 );
+    for (int i=0; i < count; i += 4) {
+        __m128i label = _mm_loadu_si128( (const __m128i*)(labels + i) );
+        __m128i ok = _mm_or_si128( _mm_cmpeq_epi8( label, targ ), _mm_cmpeq_epi8( label, zero ) );
+        int bits = _mm_movemask_ps( _mm_castsi128_ps( _mm_cmpeq_epi32( ok, ones ) ) );
+        if (count - i < 4) {
+            bits &= (1 << (count - i)) - 1;
+        }
+        if (bits) {
+            return i + WORDLIST_CTZ( bits );
+        }
+    }
+    return -1;
+}
+
+WORDLIST_TARGET("avx2")
+static int WordList_MatchEdgesAVX2( const u32 *labels, int count, u32 target )
+{
+    __m256i targ = _mm256_set1_epi32( (int)target );
+    __m256i zero = _mm256_setzero_si256();
+    __m256i ones = _mm256_set1_epi32( -1 );
+    for (int i=0; i < count; i += 8) {
+        __m256i label = _mm256_loadu_si256( (const __m256i*)(labels + i) );
+        __m256i ok = _mm256_or_si256( _mm256_cmpeq_epi8( label, targ ), _mm256_cmpeq_epi8( label, zero ) );
+        int bits = _mm256_movemask_ps( _mm256_castsi256_ps( _mm256_cmpeq_epi32( ok, ones ) ) );
+        if (count - i < 8) {
+            bits &= (1 << (count - i)) - 1;
+        }
+        if (bits) {
+            return i + WORDLIST_CTZ( bits );
+        }
+    }
+    return -1;
+}
+#endif
+
+static WordList_MatchEdgesFunc WordList_ChooseMatchEdges( void )
+{
+#if WORDLIST_SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports( "avx2" )) {
+        return WordList_MatchEdgesAVX2;
+    }
+    if (__builtin_cpu_supports( "sse2" )) {
+        return WordList_MatchEdgesSSE2;
+    }
+#elif WORDLIST_SIMD_X86
+    // The CPU having AVX2 isn't enough, the OS also has to save the ymm registers
+    // (OSXSAVE and AVX in leaf 1, then the SSE and AVX state bits in XCR0)
+    int info[4];
+    __cpuid( info, 0 );
+    int maxLeaf = info[0];
+    __cpuid( info, 1 );
+    int osAVX = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv( 0 ) & 6) == 6);
+    if (osAVX && (maxLeaf >= 7)) {
+        __cpuidex( info, 7, 0 );
+        if (info[1] & (1 << 5)) {
+            return WordList_MatchEdgesAVX2;
+        }
+    }
+    return WordList_MatchEdgesSSE2;
+#endif
+    return WordList_MatchEdgesScalar;
+}
+
+// Picked once, by the entry points that can get to WordList_MatchEdges (opening
+// a list, or the WordListNode lookups) before they do anything else, so lookups
+// on any thread see it already set.
+static WordList_MatchEdgesFunc _wordListMatchEdges = WordList_MatchEdgesScalar;
+
+#ifdef _WIN32
+static INIT_ONCE _wordListMatchEdgesOnce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK WordList_PickMatchEdges( PINIT_ONCE once, PVOID param, PVOID *context )
+{
+    _wordListMatchEdges = WordList_ChooseMatchEdges();
+    return TRUE;
+}
+
+static void WordList_InitMatchEdges( void )
+{
+    InitOnceExecuteOnce( &_wordListMatchEdgesOnce, WordList_PickMatchEdges, NULL, NULL );
+}
+#else
+static pthread_once_t _wordListMatchEdgesOnce = PTHREAD_ONCE_INIT;
+
+static void WordList_PickMatchEdges( void )
+{
+    _wordListMatchEdges = WordList_ChooseMatchEdges();
+}
+
+static void WordList_InitMatchEdges( void )
+{
+    pthread_once( &_wordListMatchEdgesOnce, WordList_PickMatchEdges );
+}
+#endif
+
+static int WordList_MatchEdges( const u32 *labels, int count, u32 target )
+{
+    // Not worth setting up the vectors for just a few edges
+    if (count < 4) {
+        return WordList_MatchEdgesScalar( labels, count, target );
+    }
+    return _wordListMatchEdges( labels, count, target );
+}
+
+// -----------------------------------------------------------------------
+// Node access
+//
+// Files can use 2, 3 or 4 byte edge indices, so nodes are read through a
+// WordListFormat rather than the WordListNode struct. The kernels below take
+// the edge index width as a parameter and are inlined into a separate copy
+// for each width, so the width is a constant inside the loops.
+// -----------------------------------------------------------------------
+
+#if defined(__GNUC__) || defined(__clang__)
+#define WORDLIST_INLINE static inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define WORDLIST_INLINE static __forceinline
+#else
+#define WORDLIST_INLINE static inline
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define WORDLIST_PREFETCH(addr) __builtin_prefetch( (addr) )
+#elif defined(_MSC_VER)
+#include <xmmintrin.h>
+#define WORDLIST_PREFETCH(addr) _mm_prefetch( (const char*)(addr), _MM_HINT_T0 )
+#else
+#define WORDLIST_PREFETCH(addr)
+#endif
+
+// The format of the WordListNode struct this was compiled with
+static const WordListFormat _wordListDefaultFormat = {
+    sizeof(WordListNode), 4, offsetof(WordListNode, edge), sizeof(edgeIndex_t), EDGE_LIMIT, 0, 0
+};
+
+WORDLIST_INLINE u32 WordList_LoadEdge( const u8 *node, const WordListFormat *format, int i, int width )
+{
+    const u8 *edge = node + format->edgesOffset + i*width;
+    if (width == 2) {
+        u16 ndx;
+        memcpy( &ndx, edge, 2 );
+        return ndx;
+    } else if (width == 3) {
+        return edge[0] | (edge[1] << 8) | ((u32)edge[2] << 16);
+    } else {
+        u32 ndx;
+        memcpy( &ndx, edge, 4 );
+        return ndx;
+    }
+}
+
+WORDLIST_INLINE const u8 *WordList_EdgeNode( const u8 *base, const WordListFormat *format,
+                                             const u8 *node, int i, int width )
+{
+    return base + (size_t)WordList_LoadEdge( node, format, i, width ) * format->nodeSize;
+}
 
-        if (WordList_StartsWith( edgeNode->label, target)) {
-            //printf("Found prefix... target is now %s\n", target );
-            return WordList_LookupImpl( base, edgeNode, target );
+WORDLIST_INLINE int WordList_LabelLen( const u8 *node, const WordListFormat *format )
+{
+    return strnlen( (const char*)node, format->labelSize );
+}
+
+// Where the copies of the children's labels are, if the format has them. These
+// come after the edges, aligned to 4 bytes from the start of the node.
+WORDLIST_INLINE const u8 *WordList_ChildLabels( const u8 *node, const WordListFormat *format, int numEdges, int width )
+{
+    return node + ((format->edgesOffset + numEdges*width + 3) & ~3);
+}
+
+// Find the child of curr whose label starts the target, or NULL. Also gives back how
+// long the matching label is, so we don't have to look at the child to find out.
+WORDLIST_INLINE const u8 *WordList_FindEdge( const u8 *base, const WordListFormat *format,
+                                             const u8 *curr, const char *target, int *labelLen, int width )
+{
+    u32 labels[WORDLIST_MAX_LABELS];
+    int numEdges = curr[ format->labelSize ];
+    if (format->childLabels) {
+        // Right here in the node, we don't need to touch the children at all
+        memcpy( labels, WordList_ChildLabels( curr, format, numEdges, width ), numEdges * 4 );
+    } else {
+        // Labels shorter than four bytes are followed by the node's edge count, mask that off
+        u32 labelMask = (format->labelSize >= 4) ? 0xFFFFFFFFu : (1u << (8*format->labelSize)) - 1;
+        for (int i=0; i < numEdges; i++) {
+            labels[i] = WordList_LoadLabel( (const char*)WordList_EdgeNode( base, format, curr, i, width ) ) & labelMask;
+        }
+    }
+    for (int i=numEdges; i < numEdges + 8; i++) {
+        labels[i] = 0;
+    }
+
+    int match = WordList_MatchEdges( labels, numEdges, WordList_LoadTarget( target ) );
+    if (match < 0) {
+        return NULL;
+    }
+    *labelLen = strnlen( (const char*)&labels[match], format->labelSize );
+    return WordList_EdgeNode( base, format, curr, match, width );
+}
+
+// Copy the word and add the terminator, returns 0 if it's too long to be in the list
+static int WordList_AddTerminator( char *buff, const char *word )
+{
+    size_t len = strlen( word );
+    if (len + 2 > MAX_WORD_LENGTH) {
+        return 0;
+    }
+    memcpy( buff, word, len );
+    buff[len] = '*';
+    buff[len+1] = '\0';
+    return 1;
+}
+
+// -----------------------------------------------------------------------
+// Succinct nodes
+//
+// See WORDLIST_NODES_SUCCINCT. Nodes are indices rather than pointers. Finding a
+// node's edges is a select on the edge bits and finding where an edge goes is
+// a rank on the tree bits, both done with popcounts, so it's a few bits per node
+// but every step down costs more than reading a packed node.
+// -----------------------------------------------------------------------
+
+#if defined(__GNUC__) || defined(__clang__)
+#define WORDLIST_POPCOUNT64(x) __builtin_popcountll(x)
+#define WORDLIST_CTZ64(x) __builtin_ctzll(x)
+#else
+static int WORDLIST_POPCOUNT64( unsigned long long x )
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+
+static int WORDLIST_CTZ64( unsigned long long x )
+{
+    return WORDLIST_POPCOUNT64( (x & (0 - x)) - 1 );
+}
+#endif
+
+typedef struct WordList_SuccinctStruct {
+    const u8 *edgeBits;
+    const u8 *zeroSamples;
+    const u8 *treeBits;
+    const u8 *treeRanks;
+    const u8 *targets;
+    const u8 *labelLengths;
+    const u8 *labelStarts;
+    const char *labels;
+    u32 targetBits;
+} WordList_Succinct;
+
+// The parts are 8 byte aligned in the file, but embedded data might not be
+WORDLIST_INLINE unsigned long long WordList_LoadBits( const u8 *bits, u32 word )
+{
+    unsigned long long result;
+    memcpy( &result, bits + (size_t)word * 8, 8 );
+    return result;
+}
+
+WORDLIST_INLINE u32 WordList_LoadU32( const u8 *data, u32 ndx )
+{
+    u32 result;
+    memcpy( &result, data + (size_t)ndx * 4, 4 );
+    return result;
+}
+
+static WordList_Succinct WordList_SuccinctView( const u8 *nodeData )
+{
+    WordListSuccinctHeader header;
+    memcpy( &header, nodeData, sizeof(header) );
+    WordList_Succinct succinct;
+    succinct.edgeBits = nodeData + header.edgeBitsOffset;
+    succinct.zeroSamples = nodeData + header.zeroSamplesOffset;
+    succinct.treeBits = nodeData + header.treeBitsOffset;
+    succinct.treeRanks = nodeData + header.treeRanksOffset;
+    succinct.targets = nodeData + header.targetsOffset;
+    succinct.labelLengths = nodeData + header.labelLengthsOffset;
+    succinct.labelStarts = nodeData + header.labelStartsOffset;
+    succinct.labels = (const char*)nodeData + header.labelsOffset;
+    succinct.targetBits = header.targetBits;
+    return succinct;
+}
+
+// Where the nth 0 is in the edge bits. Start from the sample before it, then skip
+// whole words of the rest by counting their zeros.
+static u32 WordList_SelectZero( const WordList_Succinct *succinct, u32 n )
+{
+    u32 pos = WordList_LoadU32( succinct->zeroSamples, n / 64 );
+    u32 skip = n % 64;
+    u32 word = pos / 64;
+    unsigned long long zeros = ~WordList_LoadBits( succinct->edgeBits, word ) & (~0ULL << (pos % 64));
+    u32 count;
+    while (skip >= (count = (u32)WORDLIST_POPCOUNT64( zeros ))) {
+        skip -= count;
+        zeros = ~WordList_LoadBits( succinct->edgeBits, ++word );
+    }
+    while (skip--) {
+        zeros &= zeros - 1;
+    }
+    return word * 64 + WORDLIST_CTZ64( zeros );
+}
+
+// Returns how many edges node has, and the index of the first one in firstEdge
+static int WordList_SuccinctEdges( const WordList_Succinct *succinct, u32 node, u32 *firstEdge )
+{
+    // The node's edges are the 1s after the one before it's 0
+    u32 start = node ? WordList_SelectZero( succinct, node-1 ) + 1 : 0;
+    *firstEdge = start - node;
+    u32 word = start / 64;
+    unsigned long long zeros = ~WordList_LoadBits( succinct->edgeBits, word ) & (~0ULL << (start % 64));
+    while (!zeros) {
+        zeros = ~WordList_LoadBits( succinct->edgeBits, ++word );
+    }
+    return (int)(word * 64 + WORDLIST_CTZ64( zeros ) - start);
+}
+
+// The node an edge goes to
+static u32 WordList_SuccinctChild( const WordList_Succinct *succinct, u32 edge )
+{
+    u32 rank = WordList_LoadU32( succinct->treeRanks, edge / 512 );
+    for (u32 word = (edge / 512) * 8; word < edge / 64; word++) {
+        rank += (u32)WORDLIST_POPCOUNT64( WordList_LoadBits( succinct->treeBits, word ) );
+    }
+    unsigned long long bits = WordList_LoadBits( succinct->treeBits, edge / 64 );
+    rank += (u32)WORDLIST_POPCOUNT64( bits & ((1ULL << (edge % 64)) - 1) );
+    if (bits & (1ULL << (edge % 64))) {
+        return rank + 1;
+    }
+
+    // It goes to a node that was already reached, so it's in the targets
+    unsigned long long bitPos = (unsigned long long)(edge - rank) * succinct->targetBits;
+    u32 word = (u32)(bitPos / 64);
+    u32 shift = (u32)(bitPos % 64);
+    unsigned long long value = WordList_LoadBits( succinct->targets, word ) >> shift;
+    if (shift + succinct->targetBits > 64) {
+        value |= WordList_LoadBits( succinct->targets, word+1 ) << (64 - shift);
+    }
+    return (u32)(value & ((1ULL << succinct->targetBits) - 1));
+}
+
+// Returns where the node's label is and sets its length, the label isn't nul terminated
+static const char *WordList_SuccinctLabel( const WordList_Succinct *succinct, u32 node, int *labelLen )
+{
+    // Add up the lengths before this one since the last label start, they're stored less one
+    unsigned long long lengths = WordList_LoadBits( succinct->labelLengths, node / 32 );
+    u32 slot = node % 32;
+    unsigned long long before = lengths & ((1ULL << (slot*2)) - 1);
+    u32 start = WordList_LoadU32( succinct->labelStarts, node / 32 ) + slot +
+                (u32)WORDLIST_POPCOUNT64( before & 0x5555555555555555ULL ) +
+                2 * (u32)WORDLIST_POPCOUNT64( before & 0xAAAAAAAAAAAAAAAAULL );
+    *labelLen = node ? (int)((lengths >> (slot*2)) & 3) + 1 : 0;
+    return succinct->labels + start;
+}
+
+// Finds the child of node whose label starts the target, or returns 0 (the root can't
+// be a child). Children are in label order and start with different chars, so this is
+// a binary search on the first char.
+static u32 WordList_SuccinctFindEdge( const WordList_Succinct *succinct, u32 node, const char *target, int *labelLen )
+{
+    u32 firstEdge;
+    int lo = 0;
+    int hi = WordList_SuccinctEdges( succinct, node, &firstEdge );
+    u8 ch = (u8)target[0];
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        u32 child = WordList_SuccinctChild( succinct, firstEdge + mid );
+        const char *label = WordList_SuccinctLabel( succinct, child, labelLen );
+        if ((u8)label[0] < ch) {
+            lo = mid + 1;
+        } else if ((u8)label[0] > ch) {
+            hi = mid;
+        } else {
+            return strncmp( label, target, *labelLen ) ? 0 : child;
         }
     }
     return 0;
 }
 
+// target must already have the terminator
+static int WordList_SuccinctLookup( const u8 *nodeData, const char *target )
+{
+    WordList_Succinct succinct = WordList_SuccinctView( nodeData );
+    u32 curr = 0;
+    while (*target) {
+        int labelLen;
+        curr = WordList_SuccinctFindEdge( &succinct, curr, target, &labelLen );
+        if (!curr) {
+            return 0;
+        }
+        target += labelLen;
+    }
+    return 1;
+}
+
+// -----------------------------------------------------------------------
+// Lookup
+// -----------------------------------------------------------------------
+
+WORDLIST_INLINE int WordList_LookupKernel( const u8 *base, const WordListFormat *format,
+                                           const char *target, int width )
+{
+    const u8 *curr = base;
+    target = target + WordList_LabelLen( curr, format );
+    while (1) {
+        if (*target==0) {
+            return 1; // Found the whole string
+        }
+
+        int labelLen;
+        curr = WordList_FindEdge( base, format, curr, target, &labelLen, width );
+        if (!curr) {
+            return 0;
+        }
+        target = target + labelLen;
+    }
+}
+
+static int WordList_Lookup16( const u8 *base, const WordListFormat *format, const char *target )
+{
+    return WordList_LookupKernel( base, format, target, 2 );
+}
+
+static int WordList_Lookup24( const u8 *base, const WordListFormat *format, const char *target )
+{
+    return WordList_LookupKernel( base, format, target, 3 );
+}
+
+static int WordList_Lookup32( const u8 *base, const WordListFormat *format, const char *target )
+{
+    return WordList_LookupKernel( base, format, target, 4 );
+}
+
+// target must already have the terminator
+static int WordList_LookupImpl( const u8 *base, const WordListFormat *format, const char *target )
+{
+    if (format->succinct) {
+        return WordList_SuccinctLookup( base, target );
+    }
+    switch (format->edgeIndexSize) {
+        case 2: return WordList_Lookup16( base, format, target );
+        case 3: return WordList_Lookup24( base, format, target );
+        default: return WordList_Lookup32( base, format, target );
+    }
+}
+
 int WordList_Lookup( WordListNode *worddata, char *target)
 {
     char buff[MAX_WORD_LENGTH];
     
     // add the terminator
-    strcpy( buff, target );
-    strcat( buff, "*" );
-    int result = WordList_LookupImpl( worddata, worddata, buff );
-    //printf ("WordList_Lookup: result %d\n", result );
-    return result;
+    if (!WordList_AddTerminator( buff, target )) {
+        return 0;
+    }
+    WordList_InitMatchEdges();
+    return WordList_LookupImpl( (const u8*)worddata, &_wordListDefaultFormat, buff );
 }
 
-WordList_Enumerator WordList_MakeEnumerator( WordListNode *worddata )
+int WordList_Contains( const WordList *wordlist, const char *word )
 {
-    WordList_Enumerator enumerator ={0};
-    enumerator.worddata = worddata;
-    enumerator.stack[enumerator.stacktop].node = worddata;    
-    return enumerator;
+    char buff[MAX_WORD_LENGTH];
+    if (!WordList_AddTerminator( buff, word )) {
+        return 0;
+    }
+    return WordList_LookupImpl( wordlist->nodeData, &wordlist->format, buff );
 }
 
-char *WordList_NextWord( WordList_Enumerator *enumerator )
-{        
-    while (1) {
-        if (enumerator->stacktop < 0) {
-            return NULL;
+// -----------------------------------------------------------------------
+// Batched lookup
+// -----------------------------------------------------------------------
+
+// How many lookups are in flight at once. This should be enough to cover
+// the latency of a cache miss, but not so many that the prefetches start
+// evicting each other.
+#define WORDLIST_BATCH_LANES (8)
+
+// Most children a lane prefetches for its next step. Each one costs a few
+// instructions whether it's needed or not, so more than this is slower on lists
+// that fit in the cache, and not much faster on ones that don't.
+#define WORDLIST_BATCH_PREFETCH_EDGES (2)
+
+typedef struct WordList_BatchLaneStruct {
+    const u8 *node;     // node whose children we'll check next
+    const char *target; // what's left of the word after node's label
+    int wordIndex;      // -1 if this lane is idle
+    char buff[MAX_WORD_LENGTH];
+} WordList_BatchLane;
+
+// Get ready for the next step from curr. With child labels that reads curr itself.
+// Without them it reads the label of each child, and curr was already loaded when
+// its own label was matched, so it's cheap to find those and fetch them.
+WORDLIST_INLINE void WordList_BatchPrefetch( const u8 *base, const WordListFormat *format,
+                                             const u8 *curr, int width )
+{
+    if (format->childLabels) {
+        WORDLIST_PREFETCH( curr );
+        return;
+    }
+    int numEdges = curr[ format->labelSize ];
+    if (numEdges > WORDLIST_BATCH_PREFETCH_EDGES) {
+        numEdges = WORDLIST_BATCH_PREFETCH_EDGES;
+    }
+    for (int i=0; i < numEdges; i++) {
+        WORDLIST_PREFETCH( WordList_EdgeNode( base, format, curr, i, width ) );
+    }
+}
+
+// Start the next word in this lane, returns 0 if the word finished
+// right away (or couldn't be started) and the lane is still free.
+WORDLIST_INLINE int WordList_BatchStart( const u8 *base, const WordListFormat *format, WordList_BatchLane *lane,
+                                         const char *word, int wordIndex, u8 *results )
+{
+    if (!WordList_AddTerminator( lane->buff, word )) {
+        results[wordIndex] = 0;
+        return 0;
+    }
+
+    lane->node = base;
+    lane->target = lane->buff + WordList_LabelLen( base, format );
+    lane->wordIndex = wordIndex;
+    WORDLIST_PREFETCH( base );
+    return 1;
+}
+
+// Advance a lane down one level, returns 1 if the lane is still working
+WORDLIST_INLINE int WordList_BatchStep( const u8 *base, const WordListFormat *format, WordList_BatchLane *lane,
+                                        u8 *results, int width )
+{
+    int labelLen;
+    const u8 *edgeNode = WordList_FindEdge( base, format, lane->node, lane->target, &labelLen, width );
+    if (!edgeNode) {
+        results[lane->wordIndex] = 0;
+        return 0;
+    }
+
+    lane->target += labelLen;
+    if (*lane->target==0) {
+        results[lane->wordIndex] = 1;
+        return 0;
+    }
+    lane->node = edgeNode;
+    WordList_BatchPrefetch( base, format, edgeNode, width );
+    return 1;
+}
+
+WORDLIST_INLINE void WordList_LookupBatchKernel( const u8 *base, const WordListFormat *format,
+                                                 const char **words, int n, u8 *results, int width )
+{
+    WordList_BatchLane lanes[WORDLIST_BATCH_LANES];
+    int nextWord = 0;
+    int numActive = 0;
+
+    for (int l=0; l < WORDLIST_BATCH_LANES; l++) {
+        lanes[l].wordIndex = -1;
+        while (nextWord < n) {
+            int wordIndex = nextWord++;
+            if (WordList_BatchStart( base, format, &lanes[l], words[wordIndex], wordIndex, results )) {
+                numActive++;
+                break;
+            }
         }
+    }
 
-        WordListNode *curr = enumerator->stack[ enumerator->stacktop ].node;
-        //printf("curr %p (%d)\n", curr , enumerator->stacktop);
-        enumerator->currword[ enumerator->stack[ enumerator->stacktop ].currWordLen] = '\0';
-        enumerator->stacktop--;
+    // Round-robin through the lanes, each step reads nodes that were
+    // prefetched on the previous pass so the misses overlap.
+    while (numActive > 0) {
+        for (int l=0; l < WORDLIST_BATCH_LANES; l++) {
+            WordList_BatchLane *lane = &lanes[l];
+            if (lane->wordIndex < 0) {
+                continue;
+            }
+            if (WordList_BatchStep( base, format, lane, results, width )) {
+                continue;
+            }
 
-        strncat( enumerator->currword, curr->label, 4 );
-        int wordLen = strlen( enumerator->currword );
-        if (enumerator->currword[wordLen-1]=='*') {
-            enumerator->currword[wordLen-1] = '\0';
+            // This lane finished, refill it
+            lane->wordIndex = -1;
+            numActive--;
+            while (nextWord < n) {
+                int wordIndex = nextWord++;
+                if (WordList_BatchStart( base, format, lane, words[wordIndex], wordIndex, results )) {
+                    numActive++;
+                    break;
+                }
+            }
         }
+    }
+}
 
-        // printf ("NextWord: curr word %s, wordLen %d\n", enumerator->currword, wordLen );
+static void WordList_LookupBatch16( const u8 *base, const WordListFormat *format,
+                                    const char **words, int n, u8 *results )
+{
+    WordList_LookupBatchKernel( base, format, words, n, results, 2 );
+}
 
-        if (curr->numEdges == 0) {
-            return enumerator->currword;
-        } else {
-            for (int i=curr->numEdges-1; i >= 0; i--) {
-                enumerator->stacktop++;
+static void WordList_LookupBatch24( const u8 *base, const WordListFormat *format,
+                                    const char **words, int n, u8 *results )
+{
+    WordList_LookupBatchKernel( base, format, words, n, results, 3 );
+}
 
-                enumerator->stack[enumerator->stacktop].node = enumerator->worddata + curr->edge[i];
-                enumerator->stack[enumerator->stacktop].currWordLen = wordLen;                
-            }
+static void WordList_LookupBatch32( const u8 *base, const WordListFormat *format,
+                                    const char **words, int n, u8 *results )
+{
+    WordList_LookupBatchKernel( base, format, words, n, results, 4 );
+}
+
+static void WordList_LookupBatchImpl( const u8 *base, const WordListFormat *format,
+                                      const char **words, int n, u8 *results )
+{
+    if (format->succinct) {
+        // These are small enough to stay in the cache, so there are no misses to overlap
+        char buff[MAX_WORD_LENGTH];
+        for (int i=0; i < n; i++) {
+            results[i] = (u8)(WordList_AddTerminator( buff, words[i] ) && WordList_SuccinctLookup( base, buff ));
         }
-        
-        // for (int i=0; i < curr->numEdges; i++) {
-        //     TrieNode_WordList( curr->edge[i], buff );
-        // }
+        return;
+    }
+    switch (format->edgeIndexSize) {
+        case 2: WordList_LookupBatch16( base, format, words, n, results ); break;
+        case 3: WordList_LookupBatch24( base, format, words, n, results ); break;
+        default: WordList_LookupBatch32( base, format, words, n, results ); break;
+    }
+}
+
+void WordList_LookupBatch( WordListNode *worddata, const char **words, int n, u8 *results )
+{
+    WordList_InitMatchEdges();
+    WordList_LookupBatchImpl( (const u8*)worddata, &_wordListDefaultFormat, words, n, results );
+}
+
+void WordList_ContainsBatch( const WordList *wordlist, const char **words, int n, u8 *results )
+{
+    WordList_LookupBatchImpl( wordlist->nodeData, &wordlist->format, words, n, results );
+}
+
+// -----------------------------------------------------------------------
+// Prefilter
+//
+// A split block Bloom filter: the top of the hash picks a cache line sized block
+// and the bottom, multiplied by a different odd constant for each u64, picks one
+// bit in each. At 10 bits per word about 1% of the non-words get through.
+// -----------------------------------------------------------------------
+
+static const u32 _wordListFilterSalts[8] = {
+    0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+    0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u
+};
+
+// 8 bytes at a time, then the murmur3 finalizer so every bit of the word counts
+static unsigned long long WordList_FilterHash( const char *word, size_t len )
+{
+    unsigned long long hash = 0x9E3779B97F4A7C15ULL ^ len;
+    for (; len >= 8; word += 8, len -= 8) {
+        unsigned long long chunk;
+        memcpy( &chunk, word, 8 );
+        hash = (hash ^ chunk) * 0xBF58476D1CE4E5B9ULL;
+        hash ^= hash >> 31;
+    }
+    unsigned long long tail = 0;
+    for (size_t i=0; i < len; i++) {
+        tail |= (unsigned long long)(u8)word[i] << (i*8);
+    }
+    hash = (hash ^ tail) * 0x94D049BB133111EBULL;
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+WORDLIST_INLINE size_t WordList_FilterBlock( unsigned long long hash, u32 numBlocks )
+{
+    return (size_t)(((hash >> 32) * numBlocks) >> 32) * WORDLIST_FILTER_BLOCK_SIZE;
+}
+
+void WordList_FilterAdd( u8 *filter, u32 numBlocks, const char *word, size_t len )
+{
+    unsigned long long hash = WordList_FilterHash( word, len );
+    u8 *block = filter + WordList_FilterBlock( hash, numBlocks );
+    for (int i=0; i < 8; i++) {
+        unsigned long long bits;
+        memcpy( &bits, block + i*8, 8 );
+        bits |= 1ULL << (((u32)hash * _wordListFilterSalts[i]) >> 26);
+        memcpy( block + i*8, &bits, 8 );
+    }
+}
+
+int WordList_FilterTest( const u8 *filter, u32 numBlocks, const char *word, size_t len )
+{
+    unsigned long long hash = WordList_FilterHash( word, len );
+    const u8 *block = filter + WordList_FilterBlock( hash, numBlocks );
+
+    // Check all 8 without branching, it's one cache line either way
+    unsigned long long missing = 0;
+    for (int i=0; i < 8; i++) {
+        missing |= ~WordList_LoadBits( block, i ) & (1ULL << (((u32)hash * _wordListFilterSalts[i]) >> 26));
+    }
+    return missing == 0;
+}
+
+int WordList_ContainsFiltered( const WordList *wordlist, const char *word )
+{
+    if (wordlist->filter && (!WordList_FilterTest( wordlist->filter, wordlist->filterBlocks, word, strlen( word ) ))) {
+        return 0;
+    }
+    return WordList_Contains( wordlist, word );
+}
+
+// -----------------------------------------------------------------------
+// Enumeration
+// -----------------------------------------------------------------------
+
+// Appends a label to the word at wordLen, and returns the new length with any
+// terminator taken back off, or -1 if it wouldn't fit (only for a damaged file).
+WORDLIST_INLINE int WordList_AppendLabel( char *word, int wordLen, const char *label, int labelLen )
+{
+    if (wordLen + labelLen >= MAX_WORD_LENGTH) {
+        return -1;
+    }
+    memcpy( word + wordLen, label, labelLen );
+    wordLen += labelLen;
+    if ((wordLen > 0) && (word[wordLen-1] == '*')) {
+        wordLen--;
+    }
+    return wordLen;
+}
+
+static WordList_Enumerator WordList_MakeEnumeratorImpl( const u8 *base, const WordListFormat *format )
+{
+    WordList_Enumerator enumerator ={0};
+    enumerator.nodeData = base;
+    enumerator.format = *format;
+    enumerator.splitEdge = -1;
+    enumerator.stack[0].node = 0;
+    enumerator.stack[0].nextEdge = 0;
+    if (format->succinct) {
+        // The root's label is empty
+        WordList_Succinct succinct = WordList_SuccinctView( base );
+        u32 firstEdge;
+        enumerator.stack[0].endEdge = (u8)WordList_SuccinctEdges( &succinct, 0, &firstEdge );
+        enumerator.stack[0].wordLen = 0;
+    } else {
+        enumerator.stack[0].endEdge = base[ format->labelSize ];
+        enumerator.stack[0].wordLen = (u8)WordList_AppendLabel( enumerator.currword, 0, (const char*)base,
+                                                                 WordList_LabelLen( base, format ) );
     }
+    return enumerator;
+}
+
+WordList_Enumerator WordList_MakeEnumerator( WordListNode *worddata )
+{
+    return WordList_MakeEnumeratorImpl( (const u8*)worddata, &_wordListDefaultFormat );
 }
 
+WordList_Enumerator WordList_MakeListEnumerator( const WordList *wordlist )
+{
+    return WordList_MakeEnumeratorImpl( wordlist->nodeData, &wordlist->format );
+}
+
+// Moves to the next word and leaves it in word, returns its length or -1 when there are
+// no more. The stack keeps the path from the root and how long the word was at each
+// level, so a child's label just gets copied in at its parent's length. word has to
+// start with the last word, up to the length at the top of the stack. A width of 0
+// means succinct nodes.
+WORDLIST_INLINE int WordList_NextWordKernel( WordList_Enumerator *enumerator, char *word, int width )
+{
+    const WordListFormat *format = &enumerator->format;
+    WordList_Succinct succinct;
+    if (width == 0) {
+        succinct = WordList_SuccinctView( enumerator->nodeData );
+    }
+    while (enumerator->stacktop >= 0) {
+        WordList_EnumeratorStackStruct *top = &enumerator->stack[ enumerator->stacktop ];
+        if (top->nextEdge >= top->endEdge) {
+            enumerator->stacktop--;
+            continue;
+        }
+
+        int edge = top->nextEdge++;
+        u32 child;
+        int wordLen;
+        int numEdges;
+        if (width == 0) {
+            u32 firstEdge;
+            WordList_SuccinctEdges( &succinct, top->node, &firstEdge );
+            child = WordList_SuccinctChild( &succinct, firstEdge + edge );
+            int labelLen;
+            const char *label = WordList_SuccinctLabel( &succinct, child, &labelLen );
+            wordLen = WordList_AppendLabel( word, top->wordLen, label, labelLen );
+            numEdges = WordList_SuccinctEdges( &succinct, child, &firstEdge );
+        } else {
+            const u8 *parent = enumerator->nodeData + (size_t)top->node * format->nodeSize;
+            child = WordList_LoadEdge( parent, format, edge, width );
+            const u8 *curr = enumerator->nodeData + (size_t)child * format->nodeSize;
+            wordLen = WordList_AppendLabel( word, top->wordLen, (const char*)curr,
+                                            WordList_LabelLen( curr, format ) );
+            numEdges = curr[ format->labelSize ];
+        }
+        if (wordLen < 0) {
+            continue;
+        }
+
+        if (numEdges == 0) {
+            word[wordLen] = '\0';
+            enumerator->wordNode = child;
+            return wordLen;
+        }
+
+        // Every node below the root adds a letter, so this only fills up on a damaged file
+        if (enumerator->stacktop + 1 >= WORDLIST_ENUMERATOR_DEPTH) {
+            continue;
+        }
+        WordList_EnumeratorStackStruct *next = top + 1;
+        next->node = child;
+        next->nextEdge = 0;
+        next->endEdge = numEdges;
+        next->wordLen = (u8)wordLen;
+        if ((enumerator->stacktop == 0) && (edge == enumerator->splitEdge)) {
+            next->endEdge = enumerator->splitEnd;
+        }
+        enumerator->stacktop++;
+    }
+    return -1;
+}
+
+WORDLIST_INLINE int WordList_NextWordsKernel( WordList_Enumerator *enumerator, char *buffer, int bufferSize,
+                                              u8 *lengths, int maxWords, int width )
+{
+    // Each word is put together right where it goes in the buffer, starting from a copy
+    // of the last one (the kernel only needs the part that's still on the stack). The
+    // copy is always the whole MAX_WORD_LENGTH, a fixed size copy is a couple of moves
+    // where a variable one is a call, and there's room for it.
+    const char *last = enumerator->currword;
+    int count = 0;
+    int used = 0;
+    while ((count < maxWords) && (used + MAX_WORD_LENGTH <= bufferSize)) {
+        char *word = buffer + used;
+        memmove( word, last, MAX_WORD_LENGTH );
+        int len = WordList_NextWordKernel( enumerator, word, width );
+        if (len < 0) {
+            break;
+        }
+        lengths[count++] = (u8)len;
+        used += len+1;
+        last = word;
+    }
+
+    // Leave the last word in currword too, so NextWord can carry on from here
+    if (count > 0) {
+        memcpy( enumerator->currword, last, lengths[count-1] + 1 );
+    }
+    return count;
+}
+
+static char *WordList_NextWord16( WordList_Enumerator *enumerator )
+{
+    return (WordList_NextWordKernel( enumerator, enumerator->currword, 2 ) < 0) ? NULL : enumerator->currword;
+}
+
+static char *WordList_NextWord24( WordList_Enumerator *enumerator )
+{
+    return (WordList_NextWordKernel( enumerator, enumerator->currword, 3 ) < 0) ? NULL : enumerator->currword;
+}
+
+static char *WordList_NextWord32( WordList_Enumerator *enumerator )
+{
+    return (WordList_NextWordKernel( enumerator, enumerator->currword, 4 ) < 0) ? NULL : enumerator->currword;
+}
+
+static char *WordList_NextWordSuccinct( WordList_Enumerator *enumerator )
+{
+    return (WordList_NextWordKernel( enumerator, enumerator->currword, 0 ) < 0) ? NULL : enumerator->currword;
+}
+
+char *WordList_NextWord( WordList_Enumerator *enumerator )
+{        
+    if (enumerator->format.succinct) {
+        return WordList_NextWordSuccinct( enumerator );
+    }
+    switch (enumerator->format.edgeIndexSize) {
+        case 2: return WordList_NextWord16( enumerator );
+        case 3: return WordList_NextWord24( enumerator );
+        default: return WordList_NextWord32( enumerator );
+    }
+}
+
+static int WordList_NextWords16( WordList_Enumerator *enumerator, char *buffer, int bufferSize, u8 *lengths, int maxWords )
+{
+    return WordList_NextWordsKernel( enumerator, buffer, bufferSize, lengths, maxWords, 2 );
+}
+
+static int WordList_NextWords24( WordList_Enumerator *enumerator, char *buffer, int bufferSize, u8 *lengths, int maxWords )
+{
+    return WordList_NextWordsKernel( enumerator, buffer, bufferSize, lengths, maxWords, 3 );
+}
+
+static int WordList_NextWords32( WordList_Enumerator *enumerator, char *buffer, int bufferSize, u8 *lengths, int maxWords )
+{
+    return WordList_NextWordsKernel( enumerator, buffer, bufferSize, lengths, maxWords, 4 );
+}
+
+static int WordList_NextWordsSuccinct( WordList_Enumerator *enumerator, char *buffer, int bufferSize, u8 *lengths, int maxWords )
+{
+    return WordList_NextWordsKernel( enumerator, buffer, bufferSize, lengths, maxWords, 0 );
+}
+
+int WordList_NextWords( WordList_Enumerator *enumerator, char *buffer, int bufferSize, u8 *lengths, int maxWords )
+{
+    if (enumerator->format.succinct) {
+        return WordList_NextWordsSuccinct( enumerator, buffer, bufferSize, lengths, maxWords );
+    }
+    switch (enumerator->format.edgeIndexSize) {
+        case 2: return WordList_NextWords16( enumerator, buffer, bufferSize, lengths, maxWords );
+        case 3: return WordList_NextWords24( enumerator, buffer, bufferSize, lengths, maxWords );
+        default: return WordList_NextWords32( enumerator, buffer, bufferSize, lengths, maxWords );
+    }
+}
+
+// -----------------------------------------------------------------------
+// Node access for queries
+//
+// The queries below spend their time on bookkeeping rather than reading
+// nodes, so they aren't specialized per edge index width like the lookup.
+// Nodes are passed by index so these work on succinct nodes too.
+// -----------------------------------------------------------------------
+
+static const u8 *WordList_NodeAt( const WordList *wordlist, u32 ndx )
+{
+    return wordlist->nodeData + (size_t)ndx * wordlist->format.nodeSize;
+}
+
+static int WordList_NumEdges( const WordList *wordlist, u32 ndx )
+{
+    if (wordlist->format.succinct) {
+        WordList_Succinct succinct = WordList_SuccinctView( wordlist->nodeData );
+        u32 firstEdge;
+        return WordList_SuccinctEdges( &succinct, ndx, &firstEdge );
+    }
+    return WordList_NodeAt( wordlist, ndx )[ wordlist->format.labelSize ];
+}
+
+static u32 WordList_ChildIndex( const WordList *wordlist, u32 ndx, int i )
+{
+    if (wordlist->format.succinct) {
+        WordList_Succinct succinct = WordList_SuccinctView( wordlist->nodeData );
+        u32 firstEdge;
+        WordList_SuccinctEdges( &succinct, ndx, &firstEdge );
+        return WordList_SuccinctChild( &succinct, firstEdge + i );
+    }
+    const u8 *node = WordList_NodeAt( wordlist, ndx );
+    switch (wordlist->format.edgeIndexSize) {
+        case 2: return WordList_LoadEdge( node, &wordlist->format, i, 2 );
+        case 3: return WordList_LoadEdge( node, &wordlist->format, i, 3 );
+        default: return WordList_LoadEdge( node, &wordlist->format, i, 4 );
+    }
+}
+
+// The label isn't nul terminated in succinct nodes, use the length
+static const char *WordList_NodeLabel( const WordList *wordlist, u32 ndx, int *labelLen )
+{
+    if (wordlist->format.succinct) {
+        WordList_Succinct succinct = WordList_SuccinctView( wordlist->nodeData );
+        return WordList_SuccinctLabel( &succinct, ndx, labelLen );
+    }
+    const u8 *node = WordList_NodeAt( wordlist, ndx );
+    *labelLen = WordList_LabelLen( node, &wordlist->format );
+    return (const char*)node;
+}
+
+static u32 WordList_NodeWeight( const WordList *wordlist, u32 ndx )
+{
+    return wordlist->weights ? wordlist->weights[ndx] : 0;
+}
+
+// Walk down to the node where the words starting with prefix are. If the prefix ends
+// partway through a label that's the node with that label. Gives back how much of the
+// prefix comes before that node's label, or returns 0 if no words start with prefix.
+static int WordList_FindPrefixNode( const WordList *wordlist, const char *prefix, u32 *nodeNdx, int *baseLen )
+{
+    int prefixLen = (int)strlen( prefix );
+    u32 curr = 0;
+    int pos = 0;
+    int currLabelLen = 0; // the root doesn't have a label
+    while (pos < prefixLen) {
+        int numEdges = WordList_NumEdges( wordlist, curr );
+        int found = 0;
+        for (int i=0; i < numEdges; i++) {
+            u32 child = WordList_ChildIndex( wordlist, curr, i );
+            int labelLen;
+            const char *label = WordList_NodeLabel( wordlist, child, &labelLen );
+            int remaining = prefixLen - pos;
+            if ((labelLen > 0) && (labelLen <= remaining) && (!memcmp( label, prefix + pos, labelLen ))) {
+                curr = child;
+                currLabelLen = labelLen;
+                pos += labelLen;
+                found = 1;
+                break;
+            } else if ((labelLen > remaining) && (!memcmp( label, prefix + pos, remaining ))) {
+                // The prefix ends in the middle of this label
+                *nodeNdx = child;
+                *baseLen = pos;
+                return 1;
+            }
+        }
+        if (!found) {
+            return 0;
+        }
+    }
+    *nodeNdx = curr;
+    *baseLen = pos - currLabelLen;
+    return 1;
+}
+
+// -----------------------------------------------------------------------
+// Range enumeration
+//
+// The ranges are cut at "units", the root's grandchildren in order, or a child of the
+// root when it's a word on its own. A range runs from its first unit up to the next
+// range's first unit, which is set up in the enumerator's stack.
+// -----------------------------------------------------------------------
+
+static unsigned long long WordList_UnitWeight( const WordList *wordlist, u32 node )
+{
+    return wordlist->wordCounts ? wordlist->wordCounts[node] : 1;
+}
+
+static WordList_Enumerator WordList_MakeRangeEnumerator( const WordList *wordlist, int startEdge, int startChild,
+                                                        int endEdge, int endChild )
+{
+    WordList_Enumerator enumerator = WordList_MakeListEnumerator( wordlist );
+
+    // If the range stops part way through a child of the root the kernel cuts that
+    // child short when it gets to it.
+    enumerator.stack[0].nextEdge = (u8)startEdge;
+    enumerator.stack[0].endEdge = (u8)(endEdge + (endChild > 0));
+    if (endChild > 0) {
+        enumerator.splitEdge = endEdge;
+        enumerator.splitEnd = endChild;
+    }
+
+    // Starting part way through a child, so set it up as if we'd already visited it
+    if (startChild > 0) {
+        u32 child = WordList_ChildIndex( wordlist, 0, startEdge );
+        int labelLen;
+        const char *label = WordList_NodeLabel( wordlist, child, &labelLen );
+        int wordLen = WordList_AppendLabel( enumerator.currword, enumerator.stack[0].wordLen, label, labelLen );
+        WordList_EnumeratorStackStruct *next = &enumerator.stack[1];
+        next->node = child;
+        next->nextEdge = (u8)startChild;
+        next->endEdge = (u8)((startEdge == endEdge) ? endChild : WordList_NumEdges( wordlist, child ));
+        next->wordLen = (u8)((wordLen < 0) ? 0 : wordLen);
+        enumerator.stack[0].nextEdge = (u8)(startEdge + 1);
+        enumerator.stacktop = 1;
+    }
+    return enumerator;
+}
+
+int WordList_MakeRangeEnumerators( const WordList *wordlist, WordList_Enumerator *enumerators, int numRanges )
+{
+    if (numRanges < 1) {
+        return 0;
+    }
+    int numRootEdges = WordList_NumEdges( wordlist, 0 );
+
+    unsigned long long total = 0;
+    for (int i=0; i < numRootEdges; i++) {
+        u32 child = WordList_ChildIndex( wordlist, 0, i );
+        int numEdges = WordList_NumEdges( wordlist, child );
+        if (numEdges == 0) {
+            total += WordList_UnitWeight( wordlist, child );
+        }
+        for (int j=0; j < numEdges; j++) {
+            total += WordList_UnitWeight( wordlist, WordList_ChildIndex( wordlist, child, j ) );
+        }
+    }
+
+    // A unit starts the next range once the units before it add up to that range's
+    // share of the total.
+    int numMade = 0;
+    int startEdge = 0, startChild = 0;
+    unsigned long long before = 0;
+    for (int i=0; i < numRootEdges; i++) {
+        u32 child = WordList_ChildIndex( wordlist, 0, i );
+        int numEdges = WordList_NumEdges( wordlist, child );
+        int numUnits = numEdges ? numEdges : 1;
+        for (int j=0; j < numUnits; j++) {
+            if ((before > 0) && (numMade+1 < numRanges) && (before * numRanges >= total * (numMade+1))) {
+                enumerators[numMade++] = WordList_MakeRangeEnumerator( wordlist, startEdge, startChild, i, j );
+                startEdge = i;
+                startChild = j;
+            }
+            before += WordList_UnitWeight( wordlist, numEdges ? WordList_ChildIndex( wordlist, child, j ) : child );
+        }
+    }
+    if (before > 0) {
+        enumerators[numMade++] = WordList_MakeRangeEnumerator( wordlist, startEdge, startChild, numRootEdges, 0 );
+    }
+    return numMade;
+}
+
+// -----------------------------------------------------------------------
+// Autocomplete
+//
+// A best-first search over the subtree under the prefix. Each node's weight is
+// the biggest weight below it, so when a leaf comes off the top of the heap
+// there can't be anything better left and it's the next result.
+// -----------------------------------------------------------------------
+
+#define WORDLIST_NO_PARENT (0xFFFFFFFF)
+
+typedef struct WordList_CompleteStateStruct {
+    u32 node;
+    u32 weight;
+    u32 parent;     // state for the node above this one, or WORDLIST_NO_PARENT
+    u8 labelLen;
+    u8 wordLen;     // length of the word so far, including this node's label
+} WordList_CompleteState;
+
+typedef struct WordList_CompleteSearchStruct {
+    const WordList *wordlist;
+    WordList_CompleteState *states;     // stackStates until there are too many
+    u32 *heap;
+    int numStates;
+    int maxStates;
+    int heapSize;
+    WordList_CompleteState stackStates[WORDLIST_COMPLETE_MAX_STATES];
+    u32 stackHeap[WORDLIST_COMPLETE_MAX_STATES];
+} WordList_CompleteSearch;
+
+// Higher weight first, then shorter words, then whichever we found first
+static int WordList_CompleteBefore( const WordList_CompleteSearch *search, u32 a, u32 b )
+{
+    const WordList_CompleteState *stateA = &search->states[a];
+    const WordList_CompleteState *stateB = &search->states[b];
+    if (stateA->weight != stateB->weight) {
+        return stateA->weight > stateB->weight;
+    }
+    if (stateA->wordLen != stateB->wordLen) {
+        return stateA->wordLen < stateB->wordLen;
+    }
+    return a < b;
+}
+
+// Moves the states to the heap, or to a bigger block there, when the ones on the
+// stack run out. Dropping a state would lose every word under it, so it's this
+// or stop. Returns 0 if out of memory.
+static int WordList_CompleteGrow( WordList_CompleteSearch *search )
+{
+    int maxStates = search->maxStates * 2;
+    WordList_CompleteState *states = (WordList_CompleteState*)malloc( maxStates * sizeof(WordList_CompleteState) );
+    u32 *heap = (u32*)malloc( maxStates * sizeof(u32) );
+    if (!states || !heap) {
+        free( states );
+        free( heap );
+        return 0;
+    }
+    memcpy( states, search->states, search->numStates * sizeof(WordList_CompleteState) );
+    memcpy( heap, search->heap, search->heapSize * sizeof(u32) );
+    if (search->states != search->stackStates) {
+        free( search->states );
+        free( search->heap );
+    }
+    search->states = states;
+    search->heap = heap;
+    search->maxStates = maxStates;
+    return 1;
+}
+
+// Returns 0 if there's no room for the state
+static int WordList_CompletePush( WordList_CompleteSearch *search, u32 node, u32 parent, int wordLen )
+{
+    if ((search->numStates == search->maxStates) && !WordList_CompleteGrow( search )) {
+        return 0;
+    }
+    u32 ndx = (u32)search->numStates++;
+    WordList_CompleteState *state = &search->states[ndx];
+    state->node = node;
+    state->weight = WordList_NodeWeight( search->wordlist, node );
+    state->parent = parent;
+    int labelLen;
+    WordList_NodeLabel( search->wordlist, node, &labelLen );
+    state->labelLen = (u8)labelLen;
+    state->wordLen = (u8)(wordLen + state->labelLen);
+
+    int pos = search->heapSize++;
+    while (pos > 0) {
+        int up = (pos - 1) / 2;
+        if (!WordList_CompleteBefore( search, ndx, search->heap[up] )) {
+            break;
+        }
+        search->heap[pos] = search->heap[up];
+        pos = up;
+    }
+    search->heap[pos] = ndx;
+    return 1;
+}
+
+static u32 WordList_CompletePop( WordList_CompleteSearch *search )
+{
+    u32 top = search->heap[0];
+    u32 last = search->heap[ --search->heapSize ];
+    int pos = 0;
+    while (1) {
+        int child = pos*2 + 1;
+        if (child >= search->heapSize) {
+            break;
+        }
+        if ((child + 1 < search->heapSize) &&
+            WordList_CompleteBefore( search, search->heap[child+1], search->heap[child] )) {
+            child++;
+        }
+        if (!WordList_CompleteBefore( search, search->heap[child], last )) {
+            break;
+        }
+        search->heap[pos] = search->heap[child];
+        pos = child;
+    }
+    search->heap[pos] = last;
+    return top;
+}
+
+int WordList_Complete( const WordList *wordlist, const char *prefix,
+                       WordList_Completion *results, int maxResults )
+{
+    u32 startNode;
+    int baseLen;
+    if ((maxResults <= 0) || (strlen( prefix ) + 2 > MAX_WORD_LENGTH) ||
+        (!WordList_FindPrefixNode( wordlist, prefix, &startNode, &baseLen ))) {
+        return 0;
+    }
+
+    WordList_CompleteSearch searchData;
+    WordList_CompleteSearch *search = &searchData;
+    search->wordlist = wordlist;
+    search->states = search->stackStates;
+    search->heap = search->stackHeap;
+    search->numStates = 0;
+    search->maxStates = WORDLIST_COMPLETE_MAX_STATES;
+    search->heapSize = 0;
+    WordList_CompletePush( search, startNode, WORDLIST_NO_PARENT, baseLen );
+
+    int numResults = 0;
+    int outOfMemory = 0;
+    while ((search->heapSize > 0) && (numResults < maxResults) && !outOfMemory) {
+        u32 ndx = WordList_CompletePop( search );
+        // Pushing can move the states, so no pointers into them across it
+        u32 node = search->states[ndx].node;
+        int numEdges = WordList_NumEdges( wordlist, node );
+        if (numEdges > 0) {
+            int wordLen = search->states[ndx].wordLen;
+            for (int i=0; i < numEdges; i++) {
+                if (!WordList_CompletePush( search, WordList_ChildIndex( wordlist, node, i ), ndx, wordLen )) {
+                    // Whatever comes off the heap next might not really be next, so
+                    // stop with the results we know are right
+                    outOfMemory = 1;
+                    break;
+                }
+            }
+            continue;
+        }
+
+        // A leaf, put the word together from the labels on the way back up
+        const WordList_CompleteState *state = &search->states[ndx];
+        WordList_Completion *result = &results[numResults++];
+        int wordLen = state->wordLen;
+        for (u32 s = ndx; s != WORDLIST_NO_PARENT; s = search->states[s].parent) {
+            const WordList_CompleteState *up = &search->states[s];
+            int labelLen;
+            const char *label = WordList_NodeLabel( wordlist, up->node, &labelLen );
+            memcpy( result->word + up->wordLen - up->labelLen, label, up->labelLen );
+        }
+        memcpy( result->word, prefix, baseLen );
+        if ((wordLen > 0) && (result->word[wordLen-1] == '*')) {
+            wordLen--;
+        }
+        result->word[wordLen] = '\0';
+        result->weight = state->weight;
+    }
+
+    if (search->states != search->stackStates) {
+        free( search->states );
+        free( search->heap );
+    }
+    return numResults;
+}
+
+// -----------------------------------------------------------------------
+// Pattern matching
+//
+// The pattern is run as an NFA, the set of pattern positions we could be
+// at is a bitmask that gets updated one letter at a time as we go down
+// the trie (shift-and, so a step is a few bit operations no matter how
+// long the pattern is). A branch is dropped as soon as the set is empty.
+// -----------------------------------------------------------------------
+
+#define WORDLIST_MAX_PATTERN (63)
+
+typedef unsigned long long WordList_PatternStates;
+
+typedef struct WordList_PatternSearchStruct {
+    const WordList *wordlist;
+    const char *pattern;
+    int patternLen;
+    int minLen;         // letters the pattern needs at least
+    int maxLen;         // and at most, -1 if there's a '*'
+    WordList_PatternStates starMask;        // positions with a '*'
+    WordList_PatternStates charMask[256];   // positions each char can match
+    WordList_WordFunc callback;
+    void *userData;
+    int numFound;
+    int stopped;
+    char word[MAX_WORD_LENGTH];
+} WordList_PatternSearch;
+
+// Add the positions after any '*' we're at, since it can match nothing
+static WordList_PatternStates WordList_PatternClosure( const WordList_PatternSearch *search,
+                                                       WordList_PatternStates states )
+{
+    WordList_PatternStates prev;
+    do {
+        prev = states;
+        states |= (states & search->starMask) << 1;
+    } while (states != prev);
+    return states;
+}
+
+static WordList_PatternStates WordList_PatternStep( const WordList_PatternSearch *search,
+                                                    WordList_PatternStates states, char ch )
+{
+    // Letters move on one position, stars stay where they are
+    WordList_PatternStates next = ((states & search->charMask[(u8)ch]) << 1) | (states & search->starMask);
+    return next ? WordList_PatternClosure( search, next ) : 0;
+}
+
+// Could a word with wordLen letters so far, continuing through this node, have the right length?
+static int WordList_LengthFits( const WordList *wordlist, u32 node, int wordLen, int minLen, int maxLen )
+{
+    if (!wordlist->wordLengths) {
+        return 1;
+    }
+    u32 lengths = wordlist->wordLengths[node];
+    int nodeMin = lengths & 0xFF;
+    int nodeMax = (lengths >> 8) & 0xFF;
+    return (wordLen + nodeMax >= minLen) && ((maxLen < 0) || (wordLen + nodeMin <= maxLen));
+}
+
+static void WordList_PatternVisit( WordList_PatternSearch *search, u32 nodeNdx,
+                                   WordList_PatternStates states, int wordLen )
+{
+    const WordList *wordlist = search->wordlist;
+    int labelLen;
+    const char *label = WordList_NodeLabel( wordlist, nodeNdx, &labelLen );
+    for (int i=0; i < labelLen; i++) {
+        char ch = label[i];
+        if (ch == '*') {
+            // End of a word
+            if (states & (1ULL << search->patternLen)) {
+                search->word[wordLen] = '\0';
+                search->numFound++;
+                if (!search->callback( search->word, search->userData )) {
+                    search->stopped = 1;
+                }
+            }
+            return;
+        }
+        states = WordList_PatternStep( search, states, ch );
+        if ((!states) || (wordLen + 1 >= MAX_WORD_LENGTH)) {
+            return;
+        }
+        search->word[wordLen++] = ch;
+    }
+
+    int numEdges = WordList_NumEdges( wordlist, nodeNdx );
+    for (int i=0; (i < numEdges) && (!search->stopped); i++) {
+        u32 child = WordList_ChildIndex( wordlist, nodeNdx, i );
+        if (WordList_LengthFits( wordlist, child, wordLen, search->minLen, search->maxLen )) {
+            WordList_PatternVisit( search, child, states, wordLen );
+        }
+    }
+}
+
+int WordList_MatchPattern( const WordList *wordlist, const char *pattern,
+                           WordList_WordFunc callback, void *userData )
+{
+    WordList_PatternSearch search;
+    search.wordlist = wordlist;
+    search.pattern = pattern;
+    search.patternLen = (int)strlen( pattern );
+    search.callback = callback;
+    search.userData = userData;
+    search.numFound = 0;
+    search.stopped = 0;
+    if (search.patternLen > WORDLIST_MAX_PATTERN) {
+        return 0;
+    }
+
+    search.minLen = 0;
+    search.maxLen = 0;
+    search.starMask = 0;
+    WordList_PatternStates anyMask = 0;
+    for (int i=0; i < search.patternLen; i++) {
+        if (pattern[i] == '*') {
+            search.starMask |= 1ULL << i;
+        } else if (pattern[i] == '?') {
+            anyMask |= 1ULL << i;
+        }
+    }
+    for (int ch=0; ch < 256; ch++) {
+        search.charMask[ch] = anyMask;
+    }
+    for (int i=0; i < search.patternLen; i++) {
+        if ((pattern[i] != '*') && (pattern[i] != '?')) {
+            search.charMask[(u8)pattern[i]] |= 1ULL << i;
+        }
+    }
+
+    for (int i=0; i < search.patternLen; i++) {
+        if (pattern[i] == '*') {
+            search.maxLen = -1;
+        } else {
+            search.minLen++;
+            if (search.maxLen >= 0) {
+                search.maxLen++;
+            }
+        }
+    }
+
+    WordList_PatternVisit( &search, 0, WordList_PatternClosure( &search, 1 ), 0 );
+    return search.numFound;
+}
+
+// -----------------------------------------------------------------------
+// Rack search
+//
+// Like the pattern search, but the state is how many of each tile are left.
+// A subtree is skipped if its shortest word needs more tiles than we have
+// left, or if it has no words short enough to make with the blanks alone
+// and none of the letters we have are anywhere in it.
+// -----------------------------------------------------------------------
+
+typedef struct WordList_RackSearchStruct {
+    const WordList *wordlist;
+    int counts[26];
+    u32 rackLetters;    // bit for each letter we still have at least one of
+    int blanks;
+    int rackSize;       // tiles we started with, including blanks
+    WordList_WordFunc callback;
+    void *userData;
+    int numFound;
+    int stopped;
+    char word[MAX_WORD_LENGTH];
+} WordList_RackSearch;
+
+static int WordList_RackFits( const WordList_RackSearch *search, u32 node, int wordLen )
+{
+    const WordList *wordlist = search->wordlist;
+    if (!wordlist->letters) {
+        return 1;
+    }
+    u32 letters = wordlist->letters[node];
+    int minLen = letters >> 26;
+    if (search->rackSize - wordLen < minLen) {
+        return 0;
+    }
+    return (search->blanks >= minLen) || (search->rackLetters & letters);
+}
+
+static void WordList_RackVisit( WordList_RackSearch *search, u32 nodeNdx, int wordLen )
+{
+    const WordList *wordlist = search->wordlist;
+    int labelLen;
+    const char *label = WordList_NodeLabel( wordlist, nodeNdx, &labelLen );
+
+    // Take the tiles for this label, remembering which ones to put back
+    int startLen = wordLen;
+    int usedBlanks = 0;
+    int i;
+    for (i=0; i < labelLen; i++) {
+        char ch = label[i];
+        if (ch == '*') {
+            search->word[wordLen] = '\0';
+            search->numFound++;
+            if (!search->callback( search->word, search->userData )) {
+                search->stopped = 1;
+            }
+            break;
+        }
+        int letter = ch - 'a';
+        if ((letter >= 0) && (letter < 26) && (search->counts[letter] > 0)) {
+            if (--search->counts[letter] == 0) {
+                search->rackLetters &= ~(1u << letter);
+            }
+            search->word[wordLen++] = ch;
+        } else if ((search->blanks > 0) && (ch >= 'a') && (ch <= 'z')) {
+            search->blanks--;
+            usedBlanks++;
+            search->word[wordLen++] = ch - 'a' + 'A';
+        } else if (search->blanks > 0) {
+            search->blanks--;
+            usedBlanks++;
+            search->word[wordLen++] = ch;
+        } else {
+            break;
+        }
+    }
+
+    if (i == labelLen) {
+        int numEdges = WordList_NumEdges( wordlist, nodeNdx );
+        for (int e=0; (e < numEdges) && (!search->stopped); e++) {
+            u32 child = WordList_ChildIndex( wordlist, nodeNdx, e );
+            if (WordList_RackFits( search, child, wordLen )) {
+                WordList_RackVisit( search, child, wordLen );
+            }
+        }
+    }
+
+    // Put the tiles back
+    for (int w=startLen; w < wordLen; w++) {
+        int letter = search->word[w] - 'a';
+        if ((letter >= 0) && (letter < 26)) {
+            search->counts[letter]++;
+            search->rackLetters |= 1u << letter;
+        }
+    }
+    search->blanks += usedBlanks;
+}
+
+int WordList_FindFromRack( const WordList *wordlist, const char *letters, int blanks,
+                           WordList_WordFunc callback, void *userData )
+{
+    WordList_RackSearch search;
+    memset( search.counts, 0, sizeof(search.counts) );
+    search.rackLetters = 0;
+    search.rackSize = blanks;
+    for (const char *ch = letters; *ch; ch++) {
+        if ((*ch >= 'a') && (*ch <= 'z')) {
+            search.rackSize++;
+            search.counts[*ch - 'a']++;
+            search.rackLetters |= 1u << (*ch - 'a');
+        }
+    }
+    search.wordlist = wordlist;
+    search.blanks = blanks;
+    search.callback = callback;
+    search.userData = userData;
+    search.numFound = 0;
+    search.stopped = 0;
+    WordList_RackVisit( &search, 0, 0 );
+    return search.numFound;
+}
+
+// -----------------------------------------------------------------------
+// Fuzzy search
+//
+// Each level of the walk adds a row to the edit distance table between the
+// query and the word so far. Distances are capped at maxDistance+1, since
+// anything over is just "too far", which keeps each entry in 2 bits so a
+// whole row fits in a u64. The row is everything that decides what's found
+// below a node, so when a (node, row) pair finds nothing we remember it and
+// skip it next time, which happens a lot with the shared suffixes.
+// -----------------------------------------------------------------------
+
+#define WORDLIST_FUZZY_CACHE_SIZE (1024)
+
+typedef struct WordList_FuzzyCacheEntryStruct {
+    u32 node;   // 0 is the root, which is never cached, so 0 means empty
+    unsigned long long row;
+} WordList_FuzzyCacheEntry;
+
+typedef struct WordList_FuzzySearchStruct {
+    const WordList *wordlist;
+    const char *query;
+    int queryLen;
+    int maxDistance;
+    WordList_SimilarFunc callback;
+    void *userData;
+    WordList_Suggestion *suggestions;   // or collect the best few here instead of the callback
+    int maxSuggestions;
+    int numFound;
+    int stopped;
+    char word[MAX_WORD_LENGTH];
+    WordList_FuzzyCacheEntry deadEnds[WORDLIST_FUZZY_CACHE_SIZE];
+} WordList_FuzzySearch;
+
+static unsigned long long WordList_FuzzyRowKey( const u8 *row, int len )
+{
+    unsigned long long key = 0;
+    for (int j=0; j <= len; j++) {
+        key |= (unsigned long long)row[j] << (j*2);
+    }
+    return key;
+}
+
+static WordList_FuzzyCacheEntry *WordList_FuzzyCacheSlot( WordList_FuzzySearch *search, u32 node,
+                                                          unsigned long long row )
+{
+    unsigned long long hash = (row ^ ((unsigned long long)node * 0x9E3779B97F4A7C15ULL)) * 0xFF51AFD7ED558CCDULL;
+    return &search->deadEnds[ (hash >> 32) % WORDLIST_FUZZY_CACHE_SIZE ];
+}
+
+// Keep the suggestions sorted, closest then heaviest, ties stay in the order they were found
+static void WordList_AddSuggestion( WordList_FuzzySearch *search, int count, const char *word,
+                                    int distance, u32 weight )
+{
+    if (count > search->maxSuggestions) {
+        count = search->maxSuggestions;
+    }
+    int pos = count;
+    while ((pos > 0) && ((search->suggestions[pos-1].distance > distance) ||
+                         ((search->suggestions[pos-1].distance == distance) &&
+                          (search->suggestions[pos-1].weight < weight)))) {
+        pos--;
+    }
+    if (pos >= search->maxSuggestions) {
+        return;
+    }
+    int last = (count < search->maxSuggestions) ? count : search->maxSuggestions - 1;
+    for (int i=last; i > pos; i--) {
+        search->suggestions[i] = search->suggestions[i-1];
+    }
+    WordList_Suggestion *suggestion = &search->suggestions[pos];
+    strcpy( suggestion->word, word );
+    suggestion->distance = distance;
+    suggestion->weight = weight;
+}
+
+static void WordList_FuzzyVisit( WordList_FuzzySearch *search, u32 nodeNdx, const u8 *parentRow, int wordLen )
+{
+    const WordList *wordlist = search->wordlist;
+    int labelLen;
+    const char *label = WordList_NodeLabel( wordlist, nodeNdx, &labelLen );
+    int n = search->queryLen;
+    int tooFar = search->maxDistance + 1;
+
+    u8 row[MAX_WORD_LENGTH];
+    memcpy( row, parentRow, n+1 );
+    for (int i=0; i < labelLen; i++) {
+        char ch = label[i];
+        if (ch == '*') {
+            if (row[n] < tooFar) {
+                search->word[wordLen] = '\0';
+                if (search->suggestions) {
+                    u32 weight = WordList_NodeWeight( wordlist, nodeNdx );
+                    WordList_AddSuggestion( search, search->numFound, search->word, row[n], weight );
+                } else if (!search->callback( search->word, row[n], search->userData )) {
+                    search->stopped = 1;
+                }
+                search->numFound++;
+            }
+            return;
+        }
+
+        // Only the entries within maxDistance of the diagonal can be small enough to matter,
+        // the ones outside are already tooFar from the row above
+        int rowNdx = wordLen + 1;
+        int lo = (rowNdx - search->maxDistance > 1) ? rowNdx - search->maxDistance : 1;
+        int hi = (rowNdx + search->maxDistance < n) ? rowNdx + search->maxDistance : n;
+        u8 prev = row[lo-1];
+        if (lo == 1) {
+            row[0] = (row[0] < tooFar) ? row[0] + 1 : tooFar;
+        } else {
+            row[lo-1] = tooFar;
+        }
+        int best = row[lo-1];
+        for (int j=lo; j <= hi; j++) {
+            int d = prev + ((search->query[j-1] == ch) ? 0 : 1);
+            if (row[j] + 1 < d) {
+                d = row[j] + 1;
+            }
+            if (row[j-1] + 1 < d) {
+                d = row[j-1] + 1;
+            }
+            if (d > tooFar) {
+                d = tooFar;
+            }
+            prev = row[j];
+            row[j] = (u8)d;
+            if (d < best) {
+                best = d;
+            }
+        }
+        if ((best >= tooFar) || (wordLen + 1 >= MAX_WORD_LENGTH)) {
+            return;
+        }
+        search->word[wordLen++] = ch;
+    }
+
+    unsigned long long key = WordList_FuzzyRowKey( row, n );
+    int numEdges = WordList_NumEdges( wordlist, nodeNdx );
+    for (int i=0; (i < numEdges) && (!search->stopped); i++) {
+        u32 child = WordList_ChildIndex( wordlist, nodeNdx, i );
+        WordList_FuzzyCacheEntry *slot = WordList_FuzzyCacheSlot( search, child, key );
+        if ((slot->node == child) && (slot->row == key)) {
+            continue;
+        }
+        int numFound = search->numFound;
+        WordList_FuzzyVisit( search, child, row, wordLen );
+        if (search->numFound == numFound) {
+            slot->node = child;
+            slot->row = key;
+        }
+    }
+}
+
+static int WordList_FuzzySearchRun( WordList_FuzzySearch *search, const WordList *wordlist,
+                                    const char *word, int maxDistance )
+{
+    search->wordlist = wordlist;
+    search->query = word;
+    search->queryLen = (int)strlen( word );
+    search->maxDistance = maxDistance;
+    search->numFound = 0;
+    search->stopped = 0;
+    if ((maxDistance < 0) || (maxDistance > WORDLIST_MAX_DISTANCE) ||
+        (search->queryLen + 2 > MAX_WORD_LENGTH)) {
+        return 0;
+    }
+    memset( search->deadEnds, 0, sizeof(search->deadEnds) );
+
+    // The empty word is j edits away from the first j letters of the query
+    u8 row[MAX_WORD_LENGTH];
+    for (int j=0; j <= search->queryLen; j++) {
+        row[j] = (u8)((j <= maxDistance) ? j : maxDistance + 1);
+    }
+    WordList_FuzzyVisit( search, 0, row, 0 );
+    return search->numFound;
+}
+
+int WordList_FindSimilar( const WordList *wordlist, const char *word, int maxDistance,
+                          WordList_SimilarFunc callback, void *userData )
+{
+    WordList_FuzzySearch search;
+    search.callback = callback;
+    search.userData = userData;
+    search.suggestions = NULL;
+    search.maxSuggestions = 0;
+    return WordList_FuzzySearchRun( &search, wordlist, word, maxDistance );
+}
+
+int WordList_Suggest( const WordList *wordlist, const char *word, int maxDistance,
+                      WordList_Suggestion *results, int maxResults )
+{
+    if (maxResults <= 0) {
+        return 0;
+    }
+    WordList_FuzzySearch search;
+    search.callback = NULL;
+    search.userData = NULL;
+    search.suggestions = results;
+    search.maxSuggestions = maxResults;
+    int numFound = WordList_FuzzySearchRun( &search, wordlist, word, maxDistance );
+    return (numFound < maxResults) ? numFound : maxResults;
+}
+
+// -----------------------------------------------------------------------
+// Threads
+//
+// Just enough of a wrapper for the grid solver's thread pool.
+// -----------------------------------------------------------------------
+
+#ifdef _WIN32
+typedef HANDLE WordList_Thread;
+typedef CRITICAL_SECTION WordList_Mutex;
+typedef CONDITION_VARIABLE WordList_Cond;
+
+static void WordList_MutexInit( WordList_Mutex *mutex ) { InitializeCriticalSection( mutex ); }
+static void WordList_MutexDestroy( WordList_Mutex *mutex ) { DeleteCriticalSection( mutex ); }
+static void WordList_MutexLock( WordList_Mutex *mutex ) { EnterCriticalSection( mutex ); }
+static void WordList_MutexUnlock( WordList_Mutex *mutex ) { LeaveCriticalSection( mutex ); }
+static void WordList_CondInit( WordList_Cond *cond ) { InitializeConditionVariable( cond ); }
+static void WordList_CondDestroy( WordList_Cond *cond ) { }
+static void WordList_CondWait( WordList_Cond *cond, WordList_Mutex *mutex ) { SleepConditionVariableCS( cond, mutex, INFINITE ); }
+static void WordList_CondBroadcast( WordList_Cond *cond ) { WakeAllConditionVariable( cond ); }
+
+typedef struct WordList_ThreadStartStruct {
+    void (*func)( void *arg );
+    void *arg;
+} WordList_ThreadStart;
+
+static DWORD WINAPI WordList_ThreadMain( LPVOID param )
+{
+    WordList_ThreadStart start = *(WordList_ThreadStart*)param;
+    free( param );
+    start.func( start.arg );
+    return 0;
+}
+
+static int WordList_ThreadCreate( WordList_Thread *thread, void (*func)( void *arg ), void *arg )
+{
+    WordList_ThreadStart *start = (WordList_ThreadStart*)malloc( sizeof(WordList_ThreadStart) );
+    if (!start) {
+        return 0;
+    }
+    start->func = func;
+    start->arg = arg;
+    *thread = CreateThread( NULL, 0, WordList_ThreadMain, start, 0, NULL );
+    if (!*thread) {
+        free( start );
+        return 0;
+    }
+    return 1;
+}
+
+static void WordList_ThreadJoin( WordList_Thread thread )
+{
+    WaitForSingleObject( thread, INFINITE );
+    CloseHandle( thread );
+}
+
+static int WordList_NumCores( void )
+{
+    SYSTEM_INFO info;
+    GetSystemInfo( &info );
+    return (int)info.dwNumberOfProcessors;
+}
+
+#else
+typedef pthread_t WordList_Thread;
+typedef pthread_mutex_t WordList_Mutex;
+typedef pthread_cond_t WordList_Cond;
+
+static void WordList_MutexInit( WordList_Mutex *mutex ) { pthread_mutex_init( mutex, NULL ); }
+static void WordList_MutexDestroy( WordList_Mutex *mutex ) { pthread_mutex_destroy( mutex ); }
+static void WordList_MutexLock( WordList_Mutex *mutex ) { pthread_mutex_lock( mutex ); }
+static void WordList_MutexUnlock( WordList_Mutex *mutex ) { pthread_mutex_unlock( mutex ); }
+static void WordList_CondInit( WordList_Cond *cond ) { pthread_cond_init( cond, NULL ); }
+static void WordList_CondDestroy( WordList_Cond *cond ) { pthread_cond_destroy( cond ); }
+static void WordList_CondWait( WordList_Cond *cond, WordList_Mutex *mutex ) { pthread_cond_wait( cond, mutex ); }
+static void WordList_CondBroadcast( WordList_Cond *cond ) { pthread_cond_broadcast( cond ); }
+
+typedef struct WordList_ThreadStartStruct {
+    void (*func)( void *arg );
+    void *arg;
+} WordList_ThreadStart;
+
+static void *WordList_ThreadMain( void *param )
+{
+    WordList_ThreadStart start = *(WordList_ThreadStart*)param;
+    free( param );
+    start.func( start.arg );
+    return NULL;
+}
+
+static int WordList_ThreadCreate( WordList_Thread *thread, void (*func)( void *arg ), void *arg )
+{
+    WordList_ThreadStart *start = (WordList_ThreadStart*)malloc( sizeof(WordList_ThreadStart) );
+    if (!start) {
+        return 0;
+    }
+    start->func = func;
+    start->arg = arg;
+    if (pthread_create( thread, NULL, WordList_ThreadMain, start ) != 0) {
+        free( start );
+        return 0;
+    }
+    return 1;
+}
+
+static void WordList_ThreadJoin( WordList_Thread thread )
+{
+    pthread_join( thread, NULL );
+}
+
+static int WordList_NumCores( void )
+{
+    long numCores = sysconf( _SC_NPROCESSORS_ONLN );
+    return (numCores > 0) ? (int)numCores : 1;
+}
+#endif
+
+// -----------------------------------------------------------------------
+// Grid solver
+//
+// Each starting cell is a task. Tasks are dealt out to the workers' queues
+// up front, a worker takes from the back of its own queue and when that's
+// empty steals from the front of someone else's, so threads that get
+// cells with lots of words in them don't hold everyone else up. Each worker
+// keeps its own list of found words, they're merged and deduplicated at
+// the end so the callback doesn't have to be thread safe.
+// -----------------------------------------------------------------------
+
+typedef struct WordList_GridJobStruct {
+    const WordList *wordlist;
+    const char *grid;
+    int width;
+    int height;
+    u8 numNeighbours[WORDLIST_MAX_GRID_CELLS];
+    u16 neighbours[WORDLIST_MAX_GRID_CELLS][8];
+} WordList_GridJob;
+
+typedef struct WordList_GridWorkerStruct {
+    struct WordList_ThreadPoolStruct *pool;
+    const WordList_GridJob *job;
+
+    // Task queue, other workers steal from the head
+    WordList_Mutex queueLock;
+    int tasks[WORDLIST_MAX_GRID_CELLS];
+    int head;
+    int tail;
+
+    // Found words, this is kept between grids so it doesn't have to grow every time
+    char (*found)[MAX_WORD_LENGTH];
+    int numFound;
+    int maxFound;
+    int outOfMemory;
+
+    u8 used[WORDLIST_MAX_GRID_CELLS];
+    char word[MAX_WORD_LENGTH];
+} WordList_GridWorker;
+
+struct WordList_ThreadPoolStruct {
+    int numWorkers;
+    WordList_GridWorker *workers;   // worker 0 is the thread that calls WordList_SolveGrid
+    WordList_Thread *threads;       // for the rest of the workers
+
+    WordList_Mutex lock;
+    WordList_Cond wake;
+    WordList_Cond done;
+    const WordList_GridJob *job;
+    int jobNumber;      // bumped for each grid so the threads know there's new work
+    int busyWorkers;
+    int quit;
+};
+
+static void WordList_GridAddWord( WordList_GridWorker *worker, int wordLen )
+{
+    if (worker->numFound == worker->maxFound) {
+        int maxFound = worker->maxFound ? worker->maxFound * 2 : 256;
+        char (*found)[MAX_WORD_LENGTH] = (char (*)[MAX_WORD_LENGTH])realloc( worker->found, maxFound * MAX_WORD_LENGTH );
+        if (!found) {
+            worker->outOfMemory = 1;
+            return;
+        }
+        worker->found = found;
+        worker->maxFound = maxFound;
+    }
+    memcpy( worker->found[worker->numFound], worker->word, wordLen );
+    worker->found[worker->numFound][wordLen] = '\0';
+    worker->numFound++;
+}
+
+// The path so far ends at cell and has matched labelPos chars of this node's label
+static void WordList_GridExtend( WordList_GridWorker *worker, u32 nodeNdx, int labelPos, int cell, int wordLen )
+{
+    const WordList_GridJob *job = worker->job;
+    const WordList *wordlist = job->wordlist;
+    int labelLen;
+    const char *label = WordList_NodeLabel( wordlist, nodeNdx, &labelLen );
+
+    if (labelPos == labelLen) {
+        // Only go down children that start with the terminator or a letter next to us
+        unsigned long long nextLetters = 1ULL << ('*' & 63);
+        for (int i=0; i < job->numNeighbours[cell]; i++) {
+            int next = job->neighbours[cell][i];
+            if (!worker->used[next]) {
+                nextLetters |= 1ULL << (job->grid[next] & 63);
+            }
+        }
+        int numEdges = WordList_NumEdges( wordlist, nodeNdx );
+        for (int i=0; i < numEdges; i++) {
+            u32 child = WordList_ChildIndex( wordlist, nodeNdx, i );
+            int childLabelLen;
+            if (nextLetters & (1ULL << (WordList_NodeLabel( wordlist, child, &childLabelLen )[0] & 63))) {
+                WordList_GridExtend( worker, child, 0, cell, wordLen );
+            }
+        }
+        return;
+    }
+
+    char ch = label[labelPos];
+    if (ch == '*') {
+        WordList_GridAddWord( worker, wordLen );
+        return;
+    }
+    if (wordLen + 1 >= MAX_WORD_LENGTH) {
+        return;
+    }
+
+    for (int i=0; i < job->numNeighbours[cell]; i++) {
+        int next = job->neighbours[cell][i];
+        if ((!worker->used[next]) && (job->grid[next] == ch)) {
+            worker->used[next] = 1;
+            worker->word[wordLen] = ch;
+            WordList_GridExtend( worker, nodeNdx, labelPos+1, next, wordLen+1 );
+            worker->used[next] = 0;
+        }
+    }
+}
+
+static void WordList_GridStartCell( WordList_GridWorker *worker, int cell )
+{
+    const WordList *wordlist = worker->job->wordlist;
+    char ch = worker->job->grid[cell];
+    int numEdges = WordList_NumEdges( wordlist, 0 );
+    for (int i=0; i < numEdges; i++) {
+        u32 child = WordList_ChildIndex( wordlist, 0, i );
+        int labelLen;
+        if (WordList_NodeLabel( wordlist, child, &labelLen )[0] == ch) {
+            worker->used[cell] = 1;
+            worker->word[0] = ch;
+            WordList_GridExtend( worker, child, 1, cell, 1 );
+            worker->used[cell] = 0;
+        }
+    }
+}
+
+// Returns the next task for this worker, its own or stolen, or -1 if there's nothing left
+static int WordList_GridNextTask( WordList_GridWorker *worker, WordList_GridWorker *workers, int numWorkers )
+{
+    int task = -1;
+    WordList_MutexLock( &worker->queueLock );
+    if (worker->tail > worker->head) {
+        task = worker->tasks[ --worker->tail ];
+    }
+    WordList_MutexUnlock( &worker->queueLock );
+
+    int self = (int)(worker - workers);
+    for (int i=1; (i < numWorkers) && (task < 0); i++) {
+        WordList_GridWorker *victim = &workers[ (self + i) % numWorkers ];
+        WordList_MutexLock( &victim->queueLock );
+        if (victim->tail > victim->head) {
+            task = victim->tasks[ victim->head++ ];
+        }
+        WordList_MutexUnlock( &victim->queueLock );
+    }
+    return task;
+}
+
+static void WordList_GridRunWorker( WordList_GridWorker *worker, WordList_GridWorker *workers, int numWorkers )
+{
+    int task;
+    while ((task = WordList_GridNextTask( worker, workers, numWorkers )) >= 0) {
+        WordList_GridStartCell( worker, task );
+    }
+}
+
+static void WordList_PoolThread( void *arg )
+{
+    WordList_GridWorker *worker = (WordList_GridWorker*)arg;
+    WordList_ThreadPool *pool = worker->pool;
+    int jobNumber = 0;
+    while (1) {
+        WordList_MutexLock( &pool->lock );
+        while ((!pool->quit) && (pool->jobNumber == jobNumber)) {
+            WordList_CondWait( &pool->wake, &pool->lock );
+        }
+        if (pool->quit) {
+            WordList_MutexUnlock( &pool->lock );
+            return;
+        }
+        jobNumber = pool->jobNumber;
+        WordList_MutexUnlock( &pool->lock );
+
+        WordList_GridRunWorker( worker, pool->workers, pool->numWorkers );
+
+        WordList_MutexLock( &pool->lock );
+        if (--pool->busyWorkers == 0) {
+            WordList_CondBroadcast( &pool->done );
+        }
+        WordList_MutexUnlock( &pool->lock );
+    }
+}
+
+WordList_ThreadPool *WordList_CreateThreadPool( int numThreads )
+{
+    if (numThreads <= 0) {
+        numThreads = WordList_NumCores();
+    }
+    WordList_ThreadPool *pool = (WordList_ThreadPool*)calloc( 1, sizeof(WordList_ThreadPool) );
+    if (!pool) {
+        return NULL;
+    }
+    pool->workers = (WordList_GridWorker*)calloc( numThreads, sizeof(WordList_GridWorker) );
+    pool->threads = (WordList_Thread*)calloc( numThreads, sizeof(WordList_Thread) );
+    if ((!pool->workers) || (!pool->threads)) {
+        free( pool->workers );
+        free( pool->threads );
+        free( pool );
+        return NULL;
+    }
+    WordList_MutexInit( &pool->lock );
+    WordList_CondInit( &pool->wake );
+    WordList_CondInit( &pool->done );
+    for (int i=0; i < numThreads; i++) {
+        pool->workers[i].pool = pool;
+        WordList_MutexInit( &pool->workers[i].queueLock );
+    }
+
+    // Worker 0 is whoever calls WordList_SolveGrid
+    pool->numWorkers = 1;
+    for (int i=1; i < numThreads; i++) {
+        if (!WordList_ThreadCreate( &pool->threads[i], WordList_PoolThread, &pool->workers[i] )) {
+            break;
+        }
+        pool->numWorkers++;
+    }
+    return pool;
+}
+
+void WordList_DestroyThreadPool( WordList_ThreadPool *pool )
+{
+    if (!pool) {
+        return;
+    }
+    WordList_MutexLock( &pool->lock );
+    pool->quit = 1;
+    WordList_CondBroadcast( &pool->wake );
+    WordList_MutexUnlock( &pool->lock );
+    for (int i=1; i < pool->numWorkers; i++) {
+        WordList_ThreadJoin( pool->threads[i] );
+    }
+    for (int i=0; i < pool->numWorkers; i++) {
+        WordList_MutexDestroy( &pool->workers[i].queueLock );
+        free( pool->workers[i].found );
+    }
+    WordList_CondDestroy( &pool->wake );
+    WordList_CondDestroy( &pool->done );
+    WordList_MutexDestroy( &pool->lock );
+    free( pool->workers );
+    free( pool->threads );
+    free( pool );
+}
+
+static int WordList_CompareFound( const void *a, const void *b )
+{
+    return strcmp( *(const char* const*)a, *(const char* const*)b );
+}
+
+// Merge the workers' words, drop the duplicates and report them
+static int WordList_GridReport( WordList_GridWorker *workers, int numWorkers,
+                                WordList_WordFunc callback, void *userData )
+{
+    int total = 0;
+    for (int i=0; i < numWorkers; i++) {
+        if (workers[i].outOfMemory) {
+            return -1;
+        }
+        total += workers[i].numFound;
+    }
+    const char **words = (const char**)malloc( (total ? total : 1) * sizeof(const char*) );
+    if (!words) {
+        return -1;
+    }
+    int numWords = 0;
+    for (int i=0; i < numWorkers; i++) {
+        for (int w=0; w < workers[i].numFound; w++) {
+            words[numWords++] = workers[i].found[w];
+        }
+    }
+    qsort( words, numWords, sizeof(const char*), WordList_CompareFound );
+
+    int numUnique = 0;
+    int stopped = 0;
+    for (int w=0; w < numWords; w++) {
+        if ((w > 0) && (!strcmp( words[w], words[w-1] ))) {
+            continue;
+        }
+        numUnique++;
+        if ((!stopped) && (!callback( words[w], userData ))) {
+            stopped = 1;
+        }
+    }
+    free( words );
+    return numUnique;
+}
+
+int WordList_SolveGrid( const WordList *wordlist, WordList_ThreadPool *pool,
+                        const char *grid, int width, int height,
+                        WordList_WordFunc callback, void *userData )
+{
+    int numCells = width * height;
+    if ((width <= 0) || (height <= 0) || (numCells > WORDLIST_MAX_GRID_CELLS)) {
+        return -1;
+    }
+    WordList_GridJob *job = (WordList_GridJob*)malloc( sizeof(WordList_GridJob) );
+    if (!job) {
+        return -1;
+    }
+    job->wordlist = wordlist;
+    job->grid = grid;
+    job->width = width;
+    job->height = height;
+    for (int cell=0; cell < numCells; cell++) {
+        int x = cell % width;
+        int y = cell / width;
+        job->numNeighbours[cell] = 0;
+        for (int ny = y-1; ny <= y+1; ny++) {
+            for (int nx = x-1; nx <= x+1; nx++) {
+                if ((nx >= 0) && (ny >= 0) && (nx < width) && (ny < height) && ((nx != x) || (ny != y))) {
+                    job->neighbours[cell][ job->numNeighbours[cell]++ ] = (u16)(ny * width + nx);
+                }
+            }
+        }
+    }
+
+    if (!pool) {
+        WordList_GridWorker *worker = (WordList_GridWorker*)calloc( 1, sizeof(WordList_GridWorker) );
+        if (!worker) {
+            free( job );
+            return -1;
+        }
+        WordList_MutexInit( &worker->queueLock );
+        worker->job = job;
+        for (int cell=0; cell < numCells; cell++) {
+            worker->tasks[worker->tail++] = cell;
+        }
+        WordList_GridRunWorker( worker, worker, 1 );
+        int result = WordList_GridReport( worker, 1, callback, userData );
+        WordList_MutexDestroy( &worker->queueLock );
+        free( worker->found );
+        free( worker );
+        free( job );
+        return result;
+    }
+
+    // Deal the cells out round robin so everyone starts with some
+    for (int i=0; i < pool->numWorkers; i++) {
+        WordList_GridWorker *worker = &pool->workers[i];
+        worker->job = job;
+        worker->head = 0;
+        worker->tail = 0;
+        worker->numFound = 0;
+        worker->outOfMemory = 0;
+    }
+    for (int cell=0; cell < numCells; cell++) {
+        WordList_GridWorker *worker = &pool->workers[ cell % pool->numWorkers ];
+        worker->tasks[worker->tail++] = cell;
+    }
+
+    WordList_MutexLock( &pool->lock );
+    pool->job = job;
+    pool->busyWorkers = pool->numWorkers - 1;
+    pool->jobNumber++;
+    WordList_CondBroadcast( &pool->wake );
+    WordList_MutexUnlock( &pool->lock );
+
+    WordList_GridRunWorker( &pool->workers[0], pool->workers, pool->numWorkers );
+
+    WordList_MutexLock( &pool->lock );
+    while (pool->busyWorkers > 0) {
+        WordList_CondWait( &pool->done, &pool->lock );
+    }
+    pool->job = NULL;
+    WordList_MutexUnlock( &pool->lock );
+
+    free( job );
+    return WordList_GridReport( pool->workers, pool->numWorkers, callback, userData );
+}
+
+// -----------------------------------------------------------------------
+// Word index
+//
+// Words are numbered in enumeration order, so a word's index is the number of
+// words in all the subtrees to the left of its path.
+// -----------------------------------------------------------------------
+
+int WordList_IndexOf( const WordList *wordlist, const char *word )
+{
+    char buff[MAX_WORD_LENGTH];
+    if ((!wordlist->wordCounts) || (!WordList_AddTerminator( buff, word ))) {
+        return -1;
+    }
+
+    const char *target = buff;
+    u32 node = 0;
+    u32 index = 0;
+    while (*target) {
+        int numEdges = WordList_NumEdges( wordlist, node );
+        int found = 0;
+        for (int i=0; i < numEdges; i++) {
+            u32 child = WordList_ChildIndex( wordlist, node, i );
+            int labelLen;
+            const char *label = WordList_NodeLabel( wordlist, child, &labelLen );
+            if ((labelLen > 0) && (!strncmp( label, target, labelLen ))) {
+                node = child;
+                target += labelLen;
+                found = 1;
+                break;
+            }
+            index += wordlist->wordCounts[child];
+        }
+        if (!found) {
+            return -1;
+        }
+    }
+    return (int)index;
+}
+
+int WordList_WordAt( const WordList *wordlist, u32 index, char *word )
+{
+    if ((!wordlist->wordCounts) || (index >= wordlist->wordCounts[0])) {
+        return 0;
+    }
+
+    u32 node = 0;
+    int wordLen = 0;
+    int numEdges;
+    while ((numEdges = WordList_NumEdges( wordlist, node )) > 0) {
+        int i;
+        for (i=0; i < numEdges; i++) {
+            u32 child = WordList_ChildIndex( wordlist, node, i );
+            u32 count = wordlist->wordCounts[child];
+            if (index < count) {
+                node = child;
+                break;
+            }
+            index -= count;
+        }
+        if (i == numEdges) {
+            return 0; // counts don't add up, the file is damaged
+        }
+        int labelLen;
+        const char *label = WordList_NodeLabel( wordlist, node, &labelLen );
+        if (wordLen + labelLen >= MAX_WORD_LENGTH) {
+            return 0;
+        }
+        memcpy( word + wordLen, label, labelLen );
+        wordLen += labelLen;
+    }
+    if ((wordLen > 0) && (word[wordLen-1] == '*')) {
+        wordLen--;
+    }
+    word[wordLen] = '\0';
+    return 1;
+}
+
+// -----------------------------------------------------------------------
+// Overlay
+//
+// The changes are in an open addressing hash table, with linear probing and
+// backward shift deletion so there are no tombstones to clean up. The added
+// words are also kept in a sorted array to merge them into the enumeration.
+// -----------------------------------------------------------------------
+
+typedef struct WordList_OverlayEntryStruct {
+    char *word;     // NULL for an empty slot
+    u32 hash;
+    int removed;    // 1 if the word is in the base but taken out, 0 if it's added
+} WordList_OverlayEntry;
+
+struct WordList_OverlayStruct {
+    const WordList *base;
+    WordList_OverlayEntry *slots;
+    u32 numSlots;   // power of two
+    u32 numEntries;
+    u32 numRemoved;
+    char **added;   // the added words, sorted like the enumeration
+    u32 numAdded;
+    u32 maxAdded;
+};
+
+#define WORDLIST_OVERLAY_MIN_SLOTS (64)
+
+// The order words are packed in, as if each one ended with the terminator
+static int WordList_CompareWords( const char *a, const char *b )
+{
+    while ((*a == *b) && *a) {
+        a++;
+        b++;
+    }
+    u8 nextA = *a ? (u8)*a : '*';
+    u8 nextB = *b ? (u8)*b : '*';
+    return (int)nextA - (int)nextB;
+}
+
+// Words that wordtool would pack as they are
+static int WordList_OverlayValidWord( const char *word )
+{
+    size_t len = strlen( word );
+    if ((len == 0) || (len + 2 > MAX_WORD_LENGTH)) {
+        return 0;
+    }
+    for (const char *ch = word; *ch; ch++) {
+        if (((u8)*ch <= ' ') || (*ch == '*') || (*ch == '%')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static u32 WordList_OverlayHash( const char *word )
+{
+    return WordList_Checksum( word, strlen( word ) );
+}
+
+// The slot with this word, or the empty slot where it would go
+static WordList_OverlayEntry *WordList_OverlayProbe( const WordList_Overlay *overlay, const char *word, u32 hash )
+{
+    u32 mask = overlay->numSlots - 1;
+    for (u32 ndx = hash & mask; ; ndx = (ndx + 1) & mask) {
+        WordList_OverlayEntry *entry = &overlay->slots[ndx];
+        if ((!entry->word) || ((entry->hash == hash) && (!strcmp( entry->word, word )))) {
+            return entry;
+        }
+    }
+}
+
+static int WordList_OverlayGrow( WordList_Overlay *overlay, u32 numSlots )
+{
+    WordList_OverlayEntry *oldSlots = overlay->slots;
+    u32 oldNumSlots = overlay->numSlots;
+    WordList_OverlayEntry *slots = (WordList_OverlayEntry*)calloc( numSlots, sizeof(WordList_OverlayEntry) );
+    if (!slots) {
+        return 0;
+    }
+    overlay->slots = slots;
+    overlay->numSlots = numSlots;
+    for (u32 i=0; i < oldNumSlots; i++) {
+        if (oldSlots[i].word) {
+            *WordList_OverlayProbe( overlay, oldSlots[i].word, oldSlots[i].hash ) = oldSlots[i];
+        }
+    }
+    free( oldSlots );
+    return 1;
+}
+
+// Position of word in the sorted added words, or where it would go
+static u32 WordList_OverlayAddedPos( const WordList_Overlay *overlay, const char *word )
+{
+    u32 lo = 0, hi = overlay->numAdded;
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        if (WordList_CompareWords( overlay->added[mid], word ) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static int WordList_OverlayInsert( WordList_Overlay *overlay, const char *word, u32 hash, int removed )
+{
+    if ((overlay->numEntries + 1) * 2 > overlay->numSlots) {
+        if (!WordList_OverlayGrow( overlay, overlay->numSlots * 2 )) {
+            return -1;
+        }
+    }
+    if ((!removed) && (overlay->numAdded == overlay->maxAdded)) {
+        u32 maxAdded = overlay->maxAdded ? overlay->maxAdded * 2 : 64;
+        char **added = (char**)realloc( overlay->added, maxAdded * sizeof(char*) );
+        if (!added) {
+            return -1;
+        }
+        overlay->added = added;
+        overlay->maxAdded = maxAdded;
+    }
+    size_t len = strlen( word );
+    char *copy = (char*)malloc( len + 1 );
+    if (!copy) {
+        return -1;
+    }
+    memcpy( copy, word, len + 1 );
+
+    WordList_OverlayEntry *entry = WordList_OverlayProbe( overlay, word, hash );
+    entry->word = copy;
+    entry->hash = hash;
+    entry->removed = removed;
+    overlay->numEntries++;
+    if (removed) {
+        overlay->numRemoved++;
+    } else {
+        u32 pos = WordList_OverlayAddedPos( overlay, word );
+        memmove( overlay->added + pos + 1, overlay->added + pos, (overlay->numAdded - pos) * sizeof(char*) );
+        overlay->added[pos] = copy;
+        overlay->numAdded++;
+    }
+    return 1;
+}
+
+static void WordList_OverlayDelete( WordList_Overlay *overlay, WordList_OverlayEntry *entry )
+{
+    if (entry->removed) {
+        overlay->numRemoved--;
+    } else {
+        u32 pos = WordList_OverlayAddedPos( overlay, entry->word );
+        memmove( overlay->added + pos, overlay->added + pos + 1, (overlay->numAdded - pos - 1) * sizeof(char*) );
+        overlay->numAdded--;
+    }
+    free( entry->word );
+    overlay->numEntries--;
+
+    // Move back any following entries that can now be closer to where they hash to
+    u32 mask = overlay->numSlots - 1;
+    u32 hole = (u32)(entry - overlay->slots);
+    u32 ndx = hole;
+    overlay->slots[hole].word = NULL;
+    while (1) {
+        ndx = (ndx + 1) & mask;
+        WordList_OverlayEntry *next = &overlay->slots[ndx];
+        if (!next->word) {
+            break;
+        }
+        u32 home = next->hash & mask;
+        if (((ndx - home) & mask) >= ((ndx - hole) & mask)) {
+            overlay->slots[hole] = *next;
+            next->word = NULL;
+            hole = ndx;
+        }
+    }
+}
+
+static const WordList_OverlayEntry *WordList_OverlayFind( const WordList_Overlay *overlay, const char *word )
+{
+    const WordList_OverlayEntry *entry = WordList_OverlayProbe( overlay, word, WordList_OverlayHash( word ) );
+    return entry->word ? entry : NULL;
+}
+
+WordList_Overlay *WordList_CreateOverlay( const WordList *base )
+{
+    WordList_Overlay *overlay = (WordList_Overlay*)calloc( 1, sizeof(WordList_Overlay) );
+    if (!overlay) {
+        return NULL;
+    }
+    overlay->base = base;
+    overlay->slots = (WordList_OverlayEntry*)calloc( WORDLIST_OVERLAY_MIN_SLOTS, sizeof(WordList_OverlayEntry) );
+    if (!overlay->slots) {
+        free( overlay );
+        return NULL;
+    }
+    overlay->numSlots = WORDLIST_OVERLAY_MIN_SLOTS;
+    return overlay;
+}
+
+// Frees the words and tables, but not the overlay itself
+static void WordList_OverlayRelease( WordList_Overlay *overlay )
+{
+    for (u32 i=0; i < overlay->numSlots; i++) {
+        free( overlay->slots[i].word );
+    }
+    free( overlay->slots );
+    free( overlay->added );
+}
+
+void WordList_DestroyOverlay( WordList_Overlay *overlay )
+{
+    if (!overlay) {
+        return;
+    }
+    WordList_OverlayRelease( overlay );
+    free( overlay );
+}
+
+// Puts the word in (present=1) or takes it out (present=0)
+static int WordList_OverlaySet( WordList_Overlay *overlay, const char *word, int present )
+{
+    if (!WordList_OverlayValidWord( word )) {
+        return 0;
+    }
+    u32 hash = WordList_OverlayHash( word );
+    WordList_OverlayEntry *entry = WordList_OverlayProbe( overlay, word, hash );
+    if (entry->word) {
+        if (entry->removed == present) {
+            // Back to how the base has it
+            WordList_OverlayDelete( overlay, entry );
+            return 1;
+        }
+        return 0;
+    }
+    if (WordList_Contains( overlay->base, word ) == present) {
+        return 0;
+    }
+    return WordList_OverlayInsert( overlay, word, hash, !present );
+}
+
+int WordList_OverlayAdd( WordList_Overlay *overlay, const char *word )
+{
+    return WordList_OverlaySet( overlay, word, 1 );
+}
+
+int WordList_OverlayRemove( WordList_Overlay *overlay, const char *word )
+{
+    return WordList_OverlaySet( overlay, word, 0 );
+}
+
+int WordList_OverlayContains( const WordList_Overlay *overlay, const char *word )
+{
+    if (overlay->numEntries) {
+        const WordList_OverlayEntry *entry = WordList_OverlayFind( overlay, word );
+        if (entry) {
+            return !entry->removed;
+        }
+    }
+    return WordList_Contains( overlay->base, word );
+}
+
+u32 WordList_OverlayNumWords( const WordList_Overlay *overlay )
+{
+    return overlay->base->numWords + overlay->numAdded - overlay->numRemoved;
+}
+
+int WordList_OverlayNumChanges( const WordList_Overlay *overlay )
+{
+    return (int)overlay->numEntries;
+}
+
+WordList_OverlayEnumerator WordList_MakeOverlayEnumerator( const WordList_Overlay *overlay )
+{
+    WordList_OverlayEnumerator enumerator;
+    enumerator.base = WordList_MakeListEnumerator( overlay->base );
+    enumerator.overlay = overlay;
+    enumerator.baseReady = 0;
+    enumerator.baseDone = 0;
+    enumerator.nextAdded = 0;
+    return enumerator;
+}
+
+const char *WordList_OverlayNextWord( WordList_OverlayEnumerator *enumerator )
+{
+    const WordList_Overlay *overlay = enumerator->overlay;
+    while (1) {
+        if ((!enumerator->baseReady) && (!enumerator->baseDone)) {
+            if (WordList_NextWord( &enumerator->base )) {
+                enumerator->baseReady = 1;
+            } else {
+                enumerator->baseDone = 1;
+            }
+        }
+
+        // The added words aren't in the base, so they're never equal
+        const char *added = ((u32)enumerator->nextAdded < overlay->numAdded) ? overlay->added[enumerator->nextAdded] : NULL;
+        if (added && ((!enumerator->baseReady) || (WordList_CompareWords( added, enumerator->base.currword ) < 0))) {
+            enumerator->nextAdded++;
+            return added;
+        }
+        if (!enumerator->baseReady) {
+            return NULL;
+        }
+        enumerator->baseReady = 0;
+        if (overlay->numRemoved && WordList_OverlayFind( overlay, enumerator->base.currword )) {
+            continue;
+        }
+        return enumerator->base.currword;
+    }
+}
+
+int WordList_OverlaySave( const WordList_Overlay *overlay, const char *filename )
+{
+    FILE *fp = fopen( filename, "w" );
+    if (!fp) {
+        return 0;
+    }
+    const u32 *weights = overlay->base->weights;
+    WordList_OverlayEnumerator enumerator = WordList_MakeOverlayEnumerator( overlay );
+    const char *word;
+    while ((word = WordList_OverlayNextWord( &enumerator ))) {
+        if (weights) {
+            // Added words don't have a weight
+            u32 weight = (word == enumerator.base.currword) ? weights[ enumerator.base.wordNode ] : 0;
+            fprintf( fp, "%s %u\n", word, weight );
+        } else {
+            fprintf( fp, "%s\n", word );
+        }
+    }
+    int failed = ferror( fp );
+    return (fclose( fp ) == 0) && (!failed);
+}
+
+int WordList_OverlayRebase( WordList_Overlay *overlay, const WordList *base )
+{
+    // Rebuild the table with just the changes the new base doesn't have
+    WordList_Overlay rebased = {0};
+    rebased.base = base;
+    rebased.numSlots = WORDLIST_OVERLAY_MIN_SLOTS;
+    while (rebased.numSlots < overlay->numEntries * 2) {
+        rebased.numSlots *= 2;
+    }
+    rebased.slots = (WordList_OverlayEntry*)calloc( rebased.numSlots, sizeof(WordList_OverlayEntry) );
+    if (!rebased.slots) {
+        return 0;
+    }
+    for (u32 i=0; i < overlay->numSlots; i++) {
+        const WordList_OverlayEntry *entry = &overlay->slots[i];
+        if (entry->word && (WordList_Contains( base, entry->word ) == entry->removed)) {
+            if (WordList_OverlayInsert( &rebased, entry->word, entry->hash, entry->removed ) < 0) {
+                WordList_OverlayRelease( &rebased );
+                return 0;
+            }
+        }
+    }
+    WordList_OverlayRelease( overlay );
+    *overlay = rebased;
+    return 1;
+}
+
+// -----------------------------------------------------------------------
+// Data files
+// -----------------------------------------------------------------------
+
+// FNV-1a, doesn't need to be fancy, just catch truncated or damaged files
+u32 WordList_Checksum( const void *data, size_t size )
+{
+    const u8 *bytes = (const u8*)data;
+    u32 hash = 2166136261u;
+    for (size_t i=0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int WordList_Fail( WordList *wordlist, const char *error )
+{
+    wordlist->error = error;
+    return 0;
+}
+
+// Sections have a u32 per node and go after the nodes, offset 0 means it's not there
+static int WordList_CheckSection( const WordListHeader *header, u32 offset, size_t nodesEnd )
+{
+    size_t sectionSize = (size_t)header->numNodes * sizeof(u32);
+    return (offset == 0) ||
+           ((offset >= nodesEnd) && (!(offset & 3)) && (offset + sectionSize <= header->fileSize));
+}
+
+// Checks that each part of the succinct nodes is inside the section and big enough
+static int WordList_CheckSuccinct( const WordListHeader *header, const u8 *nodeData )
+{
+    WordListSuccinctHeader succinct;
+    if (header->nodesSize < sizeof(succinct)) {
+        return 0;
+    }
+    memcpy( &succinct, nodeData, sizeof(succinct) );
+    size_t numNodes = header->numNodes;
+    size_t numEdges = succinct.numEdges;
+    if ((numEdges + 1 < numNodes) || (succinct.targetBits < 1) || (succinct.targetBits > 32)) {
+        return 0;
+    }
+    size_t numTargets = numEdges + 1 - numNodes;
+    struct { u32 offset; size_t size; } parts[] = {
+        { succinct.edgeBitsOffset,     (numEdges + numNodes + 63) / 64 * 8 },
+        { succinct.zeroSamplesOffset,  (numNodes + 63) / 64 * 4 },
+        { succinct.treeBitsOffset,     (numEdges + 63) / 64 * 8 },
+        { succinct.treeRanksOffset,    (numEdges / 512 + 1) * 4 },
+        { succinct.targetsOffset,      (numTargets * succinct.targetBits + 63) / 64 * 8 },
+        { succinct.labelLengthsOffset, (numNodes + 31) / 32 * 8 },
+        { succinct.labelStartsOffset,  (numNodes + 31) / 32 * 4 },
+        { succinct.labelsOffset,       numNodes },
+    };
+    for (size_t i=0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+        if ((parts[i].offset < sizeof(succinct)) || (parts[i].offset + parts[i].size > header->nodesSize)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int WordList_OpenMemory( WordList *wordlist, const void *data, size_t size )
+{
+    memset( wordlist, 0, sizeof(WordList) );
+    WordList_InitMatchEdges();
+
+    const WordListHeader *header = (const WordListHeader*)data;
+    if ((size < sizeof(WordListHeader)) || memcmp( header->magic, WORDLIST_MAGIC, 4 )) {
+        return WordList_Fail( wordlist, "not a word list file" );
+    }
+    if (header->version != WORDLIST_VERSION) {
+        return WordList_Fail( wordlist, "unsupported word list version" );
+    }
+    if ((header->headerSize < sizeof(WordListHeader)) || (header->nodesOffset < header->headerSize)) {
+        return WordList_Fail( wordlist, "bad header size" );
+    }
+    int succinct = (header->nodeLayout == WORDLIST_NODES_SUCCINCT);
+    u32 edgesOffset = header->edgesOffset ? header->edgesOffset : header->labelSize + 1u;
+    if (succinct) {
+        // The labels are variable length, so the node size and edges don't apply
+        if ((header->labelSize < 2) || (header->labelSize > 4) || header->childLabels) {
+            return WordList_Fail( wordlist, "word list uses a node format this code can't read" );
+        }
+    } else if ((header->edgeIndexSize < 2) || (header->edgeIndexSize > 4) ||
+        (header->labelSize < 2) || (header->labelSize > 4) || (header->nodeSize < 4) ||
+        (header->nodeLayout > WORDLIST_NODES_ALIGNED) || (edgesOffset < header->labelSize + 1u) ||
+        (header->nodeSize < edgesOffset + header->edgeLimit * header->edgeIndexSize)) {
+        return WordList_Fail( wordlist, "word list uses a node format this code can't read" );
+    }
+    size_t nodesEnd = header->nodesOffset + (succinct ? (size_t)header->nodesSize :
+                                             (size_t)header->numNodes * header->nodeSize);
+    if ((header->numNodes == 0) || (nodesEnd > size) || (header->fileSize > size) ||
+        (header->fileSize && (header->fileSize < nodesEnd))) {
+        return WordList_Fail( wordlist, "word list file is truncated" );
+    }
+    if (succinct && !WordList_CheckSuccinct( header, (const u8*)data + header->nodesOffset )) {
+        return WordList_Fail( wordlist, "bad succinct nodes" );
+    }
+    if ((!WordList_CheckSection( header, header->weightsOffset, nodesEnd )) ||
+        (!WordList_CheckSection( header, header->countsOffset, nodesEnd )) ||
+        (!WordList_CheckSection( header, header->lengthsOffset, nodesEnd )) ||
+        (!WordList_CheckSection( header, header->lettersOffset, nodesEnd ))) {
+        return WordList_Fail( wordlist, "bad section offset" );
+    }
+    if (header->filterOffset &&
+        ((header->filterOffset < nodesEnd) || (header->filterOffset % WORDLIST_FILTER_BLOCK_SIZE) ||
+         (header->filterSize == 0) || (header->filterSize % WORDLIST_FILTER_BLOCK_SIZE) ||
+         ((size_t)header->filterOffset + header->filterSize > header->fileSize))) {
+        return WordList_Fail( wordlist, "bad prefilter offset" );
+    }
+
+    wordlist->header = header;
+    wordlist->nodeData = (const u8*)data + header->nodesOffset;
+    wordlist->format.nodeSize = header->nodeSize;
+    wordlist->format.labelSize = header->labelSize;
+    wordlist->format.edgesOffset = edgesOffset;
+    wordlist->format.edgeIndexSize = header->edgeIndexSize;
+    wordlist->format.edgeLimit = header->edgeLimit;
+    wordlist->format.childLabels = header->childLabels ? 1 : 0;
+    if (succinct) {
+        memset( &wordlist->format, 0, sizeof(WordListFormat) );
+        wordlist->format.labelSize = header->labelSize;
+        wordlist->format.succinct = 1;
+    }
+    wordlist->numNodes = header->numNodes;
+    wordlist->numWords = header->numWords;
+    if (header->weightsOffset) {
+        wordlist->weights = (const u32*)((const u8*)data + header->weightsOffset);
+    }
+    if (header->countsOffset) {
+        wordlist->wordCounts = (const u32*)((const u8*)data + header->countsOffset);
+    }
+    if (header->lengthsOffset) {
+        wordlist->wordLengths = (const u32*)((const u8*)data + header->lengthsOffset);
+    }
+    if (header->lettersOffset) {
+        wordlist->letters = (const u32*)((const u8*)data + header->lettersOffset);
+    }
+    if (header->filterOffset) {
+        wordlist->filter = (const u8*)data + header->filterOffset;
+        wordlist->filterBlocks = header->filterSize / WORDLIST_FILTER_BLOCK_SIZE;
+    }
+
+    // Only hand out the nodes as structs if they match the struct
+    if (!memcmp( &wordlist->format, &_wordListDefaultFormat, sizeof(WordListFormat) )) {
+        wordlist->nodes = (WordListNode*)wordlist->nodeData;
+    }
+    return 1;
+}
+
+int WordList_Verify( const WordList *wordlist )
+{
+    const WordListHeader *header = wordlist->header;
+    size_t size = wordlist->format.succinct ? header->nodesSize :
+                  (size_t)wordlist->numNodes * wordlist->format.nodeSize;
+    if (header->fileSize) {
+        size = header->fileSize - header->nodesOffset;
+    }
+    return WordList_Checksum( wordlist->nodeData, size ) == header->dataChecksum;
+}
+
+#ifdef _WIN32
+
+int WordList_Open( WordList *wordlist, const char *filename )
+{
+    memset( wordlist, 0, sizeof(WordList) );
+
+    HANDLE file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if (file == INVALID_HANDLE_VALUE) {
+        return WordList_Fail( wordlist, "couldn't open file" );
+    }
+    LARGE_INTEGER filesz;
+    if ((!GetFileSizeEx( file, &filesz )) || (filesz.QuadPart == 0)) {
+        CloseHandle( file );
+        return WordList_Fail( wordlist, "couldn't get file size" );
+    }
+    HANDLE mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+    CloseHandle( file );
+    if (!mapping) {
+        return WordList_Fail( wordlist, "couldn't map file" );
+    }
+    void *data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+    CloseHandle( mapping );
+    if (!data) {
+        return WordList_Fail( wordlist, "couldn't map file" );
+    }
+
+    if (!WordList_OpenMemory( wordlist, data, (size_t)filesz.QuadPart )) {
+        UnmapViewOfFile( data );
+        return 0;
+    }
+    wordlist->mapping = data;
+    wordlist->mappingSize = (size_t)filesz.QuadPart;
+    return 1;
+}
+
+void WordList_Close( WordList *wordlist )
+{
+    if (wordlist->mapping) {
+        UnmapViewOfFile( wordlist->mapping );
+    }
+    memset( wordlist, 0, sizeof(WordList) );
+}
+
+#else
+
+int WordList_Open( WordList *wordlist, const char *filename )
+{
+    memset( wordlist, 0, sizeof(WordList) );
+
+    int fd = open( filename, O_RDONLY );
+    if (fd < 0) {
+        return WordList_Fail( wordlist, "couldn't open file" );
+    }
+    struct stat st;
+    if ((fstat( fd, &st ) != 0) || (st.st_size == 0)) {
+        close( fd );
+        return WordList_Fail( wordlist, "couldn't get file size" );
+    }
+    void *data = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if (data == MAP_FAILED) {
+        return WordList_Fail( wordlist, "couldn't map file" );
+    }
+
+    if (!WordList_OpenMemory( wordlist, data, (size_t)st.st_size )) {
+        munmap( data, (size_t)st.st_size );
+        return 0;
+    }
+    wordlist->mapping = data;
+    wordlist->mappingSize = (size_t)st.st_size;
+    return 1;
+}
+
+void WordList_Close( WordList *wordlist )
+{
+    if (wordlist->mapping) {
+        munmap( wordlist->mapping, wordlist->mappingSize );
+    }
+    memset( wordlist, 0, sizeof(WordList) );
+}
 
+#endif
@@ -0,0 +1,28 @@
+# Builds a word list into a target, so it's in the program's read only data instead of
+# a file to load at startup. This runs wordtool --emit=c on the word lists at build time
+# and adds the generated C source to the target. In the code, declare the data with
+# WORDLIST_EMBEDDED( <name> ) and open it with WordList_OpenMemory( &wordlist, <name>,
+# <name>_size ).
+#
+#   tk_wordlist_embed( <target> <name> <wordlist.txt>... [OPTIONS <wordtool options>...] )
+#
+# The wordtool target has to be in the build, and target_sources needs CMake 3.1.
+
+include( CMakeParseArguments )
+
+function( tk_wordlist_embed target name )
+    cmake_parse_arguments( EMBED "" "" "OPTIONS" ${ARGN} )
+    set( lists )
+    foreach( wordlist ${EMBED_UNPARSED_ARGUMENTS} )
+        get_filename_component( path ${wordlist} ABSOLUTE )
+        list( APPEND lists ${path} )
+    endforeach()
+
+    set( source ${CMAKE_CURRENT_BINARY_DIR}/${name}.c )
+    add_custom_command( OUTPUT ${source}
+                        COMMAND wordtool --emit=c ${EMBED_OPTIONS} ${lists} ${source}
+                        DEPENDS wordtool ${lists}
+                        COMMENT "Packing word list ${name}"
+                        VERBATIM )
+    target_sources( ${target} PRIVATE ${source} )
+endfunction()
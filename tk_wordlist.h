@@ -1,6 +1,7 @@
 #ifndef WORDLIST_H
 #define WORDLIST_H
 
+#include <stddef.h>
 
 
 
@@ -23,33 +24,72 @@ typedef struct WordListNodeStruct WordListNode;
 // WordListNodes, and a target word, returns 1 if the word is found, 0 otherwise.
 int WordList_Lookup( WordListNode *worddata, char *target);
 
+// Batched lookup, checks n words at once and writes 1 or 0 for each one into results.
+// This interleaves the traversals of several words and prefetches the node each one
+// will visit next, so the cache misses overlap instead of happening one after another.
+// That helps when the list is bigger than the cache (10-25% on a 19MB list). For a list
+// that stays in the cache it's about the same speed as calling WordList_Lookup in a loop.
+void WordList_LookupBatch( WordListNode *worddata, const char **words, int n, u8 *results );
+
 // -----------------------------------------------------------------------
+
+// How the nodes are laid out. For a WordListNode array this is just the struct, but
+// files can use other edge index sizes and the aligned layout, see WordList_Open.
+typedef struct WordListFormatStruct {
+	u32 nodeSize;       // bytes per node
+	u32 labelSize;      // chars in a label
+	u32 edgesOffset;    // where the edge indices start in a node
+	u32 edgeIndexSize;  // bytes per edge index, 2, 3 or 4
+	u32 edgeLimit;      // edges that fit in the node, more use the following nodes
+	u32 childLabels;    // 1 if the children's labels are stored after the edges
+	u32 succinct;       // 1 for WORDLIST_NODES_SUCCINCT, the fields above don't apply
+} WordListFormat;
+
+// One entry per level of the path from the root to the current node. Every node
+// below the root adds at least one letter, so the path is never deeper than a word.
+#define WORDLIST_ENUMERATOR_DEPTH (MAX_WORD_LENGTH+2)
+
 typedef struct WordList_EnumeratorStackStruct {
-	WordListNode *node;
-	int currWordLen;
+	u32 node;
+	u8 nextEdge;    // next child to visit
+	u8 endEdge;     // stop before this child
+	u8 wordLen;     // length of the word up to and including this node's label
 } WordList_EnumeratorStackStruct;
 
 typedef struct WordList_EnumeratorStruct {
-	WordListNode *worddata;
+	const u8 *nodeData;
+	WordListFormat format;
 	int stacktop;
-	WordList_EnumeratorStackStruct stack[100];
+	int splitEdge;  // root child where a range ends part way through, or -1
+	int splitEnd;   // ...and the child of it to stop before
+	u32 wordNode;   // the leaf the last word ended at
+	WordList_EnumeratorStackStruct stack[WORDLIST_ENUMERATOR_DEPTH];
 	char currword[MAX_WORD_LENGTH];
 } WordList_Enumerator;
 
 WordList_Enumerator WordList_MakeEnumerator( WordListNode *worddata );
 char *WordList_NextWord( WordList_Enumerator *enumerator );
 
+// Gets up to maxWords words at once, packed one after another into buffer with a nul after
+// each, and their lengths (without the nul) in lengths. Stops early rather than splitting a
+// word when the buffer gets full. Anything in the buffer past the last word may have been
+// written to as well. Returns how many words it got, 0 when there are no more.
+int WordList_NextWords( WordList_Enumerator *enumerator, char *buffer, int bufferSize, u8 *lengths, int maxWords );
+
 // -----------------------------------------------------------------------
 
-// Note: This only works because our node indices ends up being barely able to
-// fit in a u16, we have 56k nodes and max u16 is 65k. So If you are using a larger
-// word list then change this to u32
+// Edge index size for the WordListNode struct. Our node indices fit in a u16 (we have
+// 38k nodes and max u16 is 65k), so that's the default. Data files don't have to match
+// this, wordtool picks the smallest of 2, 3 or 4 byte indices that fits each word list,
+// and the functions that take a WordList handle will read any of them.
 typedef u16 edgeIndex_t;
 
 // This is how many edges we store by default with a node. If the node needs more edges it
 // will grow to use up the next entry in the packed word list. The "sweet spot" for each
 // dataset depends on how branchy it is, setting this to 2 had the smallest results for the
-// dataset I was testing.
+// dataset I was testing. This and the label size only matter for the WordListNode struct,
+// data files say what they were packed with, and wordtool --tune will find the best ones
+// for a word list.
 #define EDGE_LIMIT (2)
 
 // Pragma pack to turn off padding. This optimizes for space but may make lookups significantly
@@ -63,5 +103,350 @@ typedef struct WordListNodeStruct {
 } WordListNode;
 #pragma pack(pop)
 
+// -----------------------------------------------------------------------
+// Data files
+//
+// wordtool writes a WordListHeader followed by the packed node array. The header
+// says how the nodes were packed, so any word list can be read without recompiling
+// and we can refuse files we don't understand instead of silently getting garbage.
+// Everything is stored in little-endian byte order.
+// -----------------------------------------------------------------------
+
+#define WORDLIST_MAGIC "TKWL"
+#define WORDLIST_VERSION (1)
+
+typedef struct WordListHeaderStruct {
+    char magic[4];      // WORDLIST_MAGIC, not null terminated
+    u16 version;        // WORDLIST_VERSION
+    u16 headerSize;     // sizeof(WordListHeader) when the file was written
+    u32 numNodes;       // number of WordListNode entries (including edge overflow entries)
+    u32 numWords;       // number of words in the list
+    u8 edgeIndexSize;   // bytes per edge index, 2, 3 or 4
+    u8 edgeLimit;       // edges that fit in one node
+    u8 labelSize;       // number of chars in a node label, 2, 3 or 4
+    u8 nodeSize;        // bytes per node
+    u32 nodesOffset;    // byte offset of the node array from the start of the file
+    u32 dataChecksum;   // WordList_Checksum of everything from nodesOffset to the end of the file
+    u8 nodeLayout;      // WORDLIST_NODES_PACKED, WORDLIST_NODES_ALIGNED or WORDLIST_NODES_SUCCINCT
+    u8 edgesOffset;     // where the edge indices start in a node, 0 means labelSize+1
+    u8 childLabels;     // 1 if each node has a copy of its children's labels after its edges
+    u8 pad;
+    u32 fileSize;       // total size of the file, including the header
+    u32 weightsOffset;  // byte offset of the weights section, 0 if the list has no weights
+    u32 countsOffset;   // byte offset of the word counts section, 0 if there isn't one
+    u32 lengthsOffset;  // byte offset of the word lengths section, 0 if there isn't one
+    u32 lettersOffset;  // byte offset of the letters section, 0 if there isn't one
+    u32 nodesSize;      // bytes of succinct nodes, 0 for the others (they're numNodes * nodeSize)
+    u32 filterOffset;   // byte offset of the prefilter, 0 if there isn't one
+    u32 filterSize;     // bytes in the prefilter, a multiple of WORDLIST_FILTER_BLOCK_SIZE
+} WordListHeader;
+
+// Packed nodes have no padding at all, like the WordListNode struct. This is the smallest
+// but the edge indices are unaligned and nodes can straddle cache lines.
+#define WORDLIST_NODES_PACKED (0)
+
+// Aligned nodes are padded to 8 or 16 bytes and the edge indices are naturally aligned,
+// so a node's label and first few edges never straddle a cache line. This is bigger but
+// faster to read. Nodes that have more edges than fit still continue into the following
+// nodes, and those extra edges can cross into the next cache line.
+#define WORDLIST_NODES_ALIGNED (1)
+
+// Succinct nodes (wordtool --succinct) are a few bits per node, for when memory is tight.
+// Lookups are a few times slower than the other layouts, but every function that takes a
+// WordList works. The nodes are numbered breadth first and the section starts with a
+// WordListSuccinctHeader, the offsets in it are from the start of the section and each
+// part is 8 byte aligned. The bit vectors are arrays of little endian u64s.
+//
+// Edge bits: LOUDS, for each node in order a 1 for each edge and then a 0. Edges are
+// numbered in the same order, so node i's edges come after the (i-1)th 0.
+// Zero samples: a u32 per 64 nodes, where in the edge bits the (64*j)th 0 is.
+// Tree bits: a bit per edge, 1 if it's the first edge to reach its child. Breadth first
+// numbering means the nth of those points to node n+1, so they don't need a node index.
+// Tree ranks: a u32 per 512 edges, how many tree bits are set before that.
+// Targets: the node index for each of the other edges, targetBits each, packed together.
+// Label lengths: 2 bits per node, the label length - 1. The root gets one unused char.
+// Label starts: a u32 per 32 nodes, where that node's label starts in the labels.
+// Labels: all of the labels, one after the other with nothing in between.
+#define WORDLIST_NODES_SUCCINCT (2)
+
+typedef struct WordListSuccinctHeaderStruct {
+    u32 numEdges;
+    u32 targetBits;         // bits per node index in the targets
+    u32 edgeBitsOffset;
+    u32 zeroSamplesOffset;
+    u32 treeBitsOffset;
+    u32 treeRanksOffset;
+    u32 targetsOffset;
+    u32 labelLengthsOffset;
+    u32 labelStartsOffset;
+    u32 labelsOffset;
+} WordListSuccinctHeader;
+
+// Optional sections follow the nodes, each is 4 byte aligned and has one entry per
+// node (including the edge overflow entries, which are unused) so it can be indexed
+// with the same node index as the node array.
+//
+// Weights: a u32 per node. For a leaf it's the weight of the word that ends there,
+// for anything else it's the biggest weight of any word below it.
+//
+// Word counts: a u32 per node, the number of words below it (1 for a leaf). These let
+// WordList_IndexOf and WordList_WordAt skip over whole subtrees.
+//
+// Word lengths: a u32 per node, the shortest (low byte) and longest (next byte) number
+// of letters from the start of this node's label to the end of a word, not counting
+// the terminator. The searches use these to skip subtrees with no words that would fit.
+//
+// Letters: a u32 per node, bit n is set if letter 'a'+n is used anywhere from the start
+// of this node's label down, and the top 6 bits are the shortest word length from the
+// word lengths section again, so WordList_FindFromRack only has to read one of these
+// to decide whether to skip a subtree.
+//
+// Prefilter: a blocked Bloom filter of all the words (wordtool --filter), 64 byte
+// aligned in the file. Each word hashes to one block and sets one bit in each of its
+// 8 u64s, so checking a word reads a single cache line. This one isn't per node.
+
+#define WORDLIST_FILTER_BLOCK_SIZE (64)
+
+typedef struct WordListStruct {
+    const WordListHeader *header;
+    const u8 *nodeData;
+    WordListFormat format;
+    WordListNode *nodes;    // nodeData as structs for WordList_Lookup, NULL if the file uses a different format
+    u32 numNodes;
+    u32 numWords;
+    const u32 *weights;     // per node max weights, NULL if the file doesn't have them
+    const u32 *wordCounts;  // per node word counts, NULL if the file doesn't have them
+    const u32 *wordLengths; // per node min and max word lengths, NULL if the file doesn't have them
+    const u32 *letters;     // per node masks of the letters below, NULL if the file doesn't have them
+    const u8 *filter;       // prefilter blocks, NULL if the file doesn't have one
+    u32 filterBlocks;
+    const char *error;      // why WordList_Open failed
+
+    // Internal, for WordList_Close
+    void *mapping;
+    size_t mappingSize;
+} WordList;
+
+// Maps a wordlist.dat file read-only and checks the header. Nothing is read or copied
+// up front, so this takes the same time no matter how big the list is, and the pages are
+// shared between processes that open the same file. Returns 1 on success, or 0 and sets
+// wordlist->error if the file can't be opened or isn't a word list this code can read.
+int WordList_Open( WordList *wordlist, const char *filename );
+void WordList_Close( WordList *wordlist );
+
+// Same as WordList_Open for data you've already loaded or embedded yourself. The data is used
+// in place and must stay around while the WordList is used. WordList_Close does nothing for these.
+int WordList_OpenMemory( WordList *wordlist, const void *data, size_t size );
+
+// Declares a word list built into the program with wordtool --emit=c or --emit=incbin (or the
+// tk_wordlist_embed CMake function), so it can be opened with WordList_OpenMemory( &wordlist,
+// name, name_size ). It's in the program's read only data, so there's nothing to load.
+#ifdef __cplusplus
+#define WORDLIST_EMBEDDED(name) extern "C" const unsigned char name[]; extern "C" const size_t name##_size
+#else
+#define WORDLIST_EMBEDDED(name) extern const unsigned char name[]; extern const size_t name##_size
+#endif
+
+// Checks the node data and sections against the checksum in the header. This has to read
+// the whole file, so WordList_Open doesn't do it. Returns 1 if it matches.
+int WordList_Verify( const WordList *wordlist );
+
+u32 WordList_Checksum( const void *data, size_t size );
+
+// Same as WordList_Lookup, WordList_LookupBatch and WordList_MakeEnumerator but these work with
+// any edge index size, using lookup and enumeration code specialized for each size.
+int WordList_Contains( const WordList *wordlist, const char *word );
+void WordList_ContainsBatch( const WordList *wordlist, const char **words, int n, u8 *results );
+WordList_Enumerator WordList_MakeListEnumerator( const WordList *wordlist );
+
+// Same as WordList_Contains, but checks the prefilter first if the list has one (wordtool
+// --filter). Most words that aren't in the list are turned away after one cache line of
+// the filter, without going down the nodes. Use this when most of the words you check
+// aren't words, like validating typed input. Without a prefilter it's WordList_Contains.
+int WordList_ContainsFiltered( const WordList *wordlist, const char *word );
+
+// Adds a word to a prefilter, or returns 0 if it's definitely not in it and 1 if it might
+// be. wordtool uses these to build the filter, WordList_ContainsFiltered is easier to use.
+void WordList_FilterAdd( u8 *filter, u32 numBlocks, const char *word, size_t len );
+int WordList_FilterTest( const u8 *filter, u32 numBlocks, const char *word, size_t len );
+
+// Splits the list into up to numRanges enumerators that each go over a different range of
+// the words, in order, so they can run on separate threads. The ranges are cut between
+// the root's children and grandchildren, balanced by word count if the file has word
+// counts (wordtool --word-index), otherwise by the number of grandchildren. Returns how
+// many ranges it made, which is less than numRanges for tiny lists.
+int WordList_MakeRangeEnumerators( const WordList *wordlist, WordList_Enumerator *enumerators, int numRanges );
+
+// -----------------------------------------------------------------------
+// Autocomplete
+// -----------------------------------------------------------------------
+
+typedef struct WordList_CompletionStruct {
+    char word[MAX_WORD_LENGTH];
+    u32 weight;         // 0 if the list has no weights
+} WordList_Completion;
+
+// How many nodes WordList_Complete queues up on the stack (20 bytes each). That's plenty
+// for a few dozen results, asking for hundreds needs more and moves them to the heap.
+#define WORDLIST_COMPLETE_MAX_STATES (2048)
+
+// Finds up to maxResults words that start with prefix, highest weight first, and returns
+// how many it found. The prefix can end partway through a node's label. This only looks
+// at the branches that could still beat what it's found so far, using the max weight of
+// each subtree stored by wordtool, so it's fast even for short prefixes. Words with the
+// same weight (or every word, if the list has no weights) come shortest first. It only
+// finds fewer than maxResults when there aren't that many words, or it runs out of memory.
+int WordList_Complete( const WordList *wordlist, const char *prefix,
+                       WordList_Completion *results, int maxResults );
+
+// -----------------------------------------------------------------------
+// Searches
+// -----------------------------------------------------------------------
+
+// Called with each word a search finds. Return 1 to keep going or 0 to stop the search.
+typedef int (*WordList_WordFunc)( const char *word, void *userData );
+
+// Calls callback for each word that matches a crossword style pattern, in enumeration order,
+// and returns how many it found. In the pattern '?' matches any one letter and '*' matches
+// any number of letters (including none), e.g. "c?t", "?a??le" or "re*ing". Everything else
+// has to match exactly. Branches that can't match are skipped as soon as possible, and if
+// the list has word lengths (wordtool --summaries) so are the ones where no word has the
+// right length. Patterns can be at most 63 chars.
+int WordList_MatchPattern( const WordList *wordlist, const char *pattern,
+                           WordList_WordFunc callback, void *userData );
+
+// Calls callback for each word that can be made from the tiles in letters (a-z, each tile
+// can be used once, in any order) plus some number of blank tiles that can be any letter,
+// and returns how many it found. Letters are taken from the rack before using a blank, and
+// letters that used a blank come back upper case, e.g. "quIz". With the per node summaries
+// from wordtool --summaries, subtrees that need letters the rack doesn't have are skipped.
+int WordList_FindFromRack( const WordList *wordlist, const char *letters, int blanks,
+                           WordList_WordFunc callback, void *userData );
+
+// -----------------------------------------------------------------------
+// Spelling suggestions
+// -----------------------------------------------------------------------
+
+// Called with each word WordList_FindSimilar finds and its edit distance from the query.
+// Return 1 to keep going or 0 to stop the search.
+typedef int (*WordList_SimilarFunc)( const char *word, int distance, void *userData );
+
+// The biggest edit distance the fuzzy searches support
+#define WORDLIST_MAX_DISTANCE (2)
+
+// Calls callback for each word within maxDistance (0 to WORDLIST_MAX_DISTANCE) insertions,
+// deletions or substitutions of word, in enumeration order, and returns how many it found.
+// This works out the edit distance a letter at a time on the way down the trie, so words
+// that share a prefix share the work, and drops a branch as soon as every word in it would
+// be too far away.
+int WordList_FindSimilar( const WordList *wordlist, const char *word, int maxDistance,
+                          WordList_SimilarFunc callback, void *userData );
+
+typedef struct WordList_SuggestionStruct {
+    char word[MAX_WORD_LENGTH];
+    int distance;
+    u32 weight;         // 0 if the list has no weights
+} WordList_Suggestion;
+
+// Spellcheck suggestions, the best maxResults words within maxDistance of word, closest first.
+// Words at the same distance come highest weight first if the list has weights. Returns how
+// many it found. If the word is in the list it comes first, with a distance of 0.
+int WordList_Suggest( const WordList *wordlist, const char *word, int maxDistance,
+                      WordList_Suggestion *results, int maxResults );
+
+// -----------------------------------------------------------------------
+// Grid solver
+// -----------------------------------------------------------------------
+
+// Worker threads for WordList_SolveGrid. Make one up front and reuse it, starting threads
+// for every grid would cost more than solving it.
+struct WordList_ThreadPoolStruct;
+typedef struct WordList_ThreadPoolStruct WordList_ThreadPool;
+
+// numThreads includes the thread that calls WordList_SolveGrid, which does some of the work
+// too. 0 means one per CPU core. Returns NULL if the threads can't be started.
+WordList_ThreadPool *WordList_CreateThreadPool( int numThreads );
+void WordList_DestroyThreadPool( WordList_ThreadPool *pool );
+
+// Biggest grid WordList_SolveGrid will take, width*height
+#define WORDLIST_MAX_GRID_CELLS (1024)
+
+// Finds every word that can be traced through a Boggle style grid, moving to any of the
+// 8 neighbouring cells each letter and using each cell at most once per word. grid has
+// width*height letters, row by row. The grid and the trie are walked together, so a path
+// is dropped as soon as no word continues with its next letter. Each starting cell is a
+// task for the pool, idle threads steal tasks from busy ones. Words found along more than
+// one path are only reported once, and callback is called on the calling thread after the
+// search, in sorted order. pool can be NULL to do it all on the calling thread. Returns
+// the number of different words found, or -1 if the grid is too big or it ran out of memory.
+int WordList_SolveGrid( const WordList *wordlist, WordList_ThreadPool *pool,
+                        const char *grid, int width, int height,
+                        WordList_WordFunc callback, void *userData );
+
+// -----------------------------------------------------------------------
+// Word index
+//
+// If the list was packed with word counts (wordtool --word-index), every word has a
+// dense index from 0 to numWords-1, in the same order WordList_NextWord returns them.
+// Use this to keep your own per-word data in a plain array instead of a hash table.
+// -----------------------------------------------------------------------
+
+// Returns the index of word, or -1 if it isn't in the list or the list doesn't have word counts
+int WordList_IndexOf( const WordList *wordlist, const char *word );
+
+// Copies the word with this index into word, which must have room for MAX_WORD_LENGTH chars.
+// Returns 0 if the index is out of range or the list doesn't have word counts.
+int WordList_WordAt( const WordList *wordlist, u32 index, char *word );
+
+// -----------------------------------------------------------------------
+// Overlay
+//
+// Adds and removes words on top of a packed list without repacking it. The overlay only
+// keeps the words that differ from the packed list, in a small hash table, so a lookup is
+// one probe plus the normal lookup. To fold the changes into a new pack, write the list out
+// with WordList_OverlaySave, pack that with wordtool --sorted (on another thread or process,
+// the overlay can still be used meanwhile), open the new file and pass it to
+// WordList_OverlayRebase, which drops the changes the new file already has.
+//
+// Changing an overlay isn't safe while other threads are reading it.
+// -----------------------------------------------------------------------
+
+typedef struct WordList_OverlayStruct WordList_Overlay;
+
+// The base list has to stay open while the overlay uses it. Returns NULL if out of memory.
+WordList_Overlay *WordList_CreateOverlay( const WordList *base );
+void WordList_DestroyOverlay( WordList_Overlay *overlay );
+
+// Returns 1 if this changed the list, 0 if the word was already in (or out) or can't be
+// packed (too long, or has '*', '%' or whitespace in it), or -1 if out of memory.
+int WordList_OverlayAdd( WordList_Overlay *overlay, const char *word );
+int WordList_OverlayRemove( WordList_Overlay *overlay, const char *word );
+
+int WordList_OverlayContains( const WordList_Overlay *overlay, const char *word );
+
+// Number of words in the list with the changes, and number of changes the base doesn't have
+u32 WordList_OverlayNumWords( const WordList_Overlay *overlay );
+int WordList_OverlayNumChanges( const WordList_Overlay *overlay );
+
+// Enumerates the list with the changes, in the same order as WordList_NextWord. The overlay
+// can't be changed while this is in use.
+typedef struct WordList_OverlayEnumeratorStruct {
+	WordList_Enumerator base;
+	const WordList_Overlay *overlay;
+	int baseReady;  // base.currword has a word we haven't returned yet
+	int baseDone;
+	int nextAdded;
+} WordList_OverlayEnumerator;
+
+WordList_OverlayEnumerator WordList_MakeOverlayEnumerator( const WordList_Overlay *overlay );
+const char *WordList_OverlayNextWord( WordList_OverlayEnumerator *enumerator );
+
+// Writes the list with the changes as a word list wordtool can read, sorted so it works with
+// --sorted, and with the weights if the base list has them. Returns 1 if it worked.
+int WordList_OverlaySave( const WordList_Overlay *overlay, const char *filename );
+
+// Switches the overlay to a new base list, keeping only the changes it doesn't already have.
+// Returns 0 if out of memory, the overlay still uses the old base then.
+int WordList_OverlayRebase( WordList_Overlay *overlay, const WordList *base );
 
 #endif
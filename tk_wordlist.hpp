@@ -0,0 +1,265 @@
+#ifndef TK_WORDLIST_HPP
+#define TK_WORDLIST_HPP
+
+// Header only C++17 front end for the packed word lists. This reads the same files and
+// WordListNode arrays as tk_wordlist.c, but doesn't need it to be linked in. The node format
+// is a template parameter, so the edge index width, node size and EDGE_LIMIT are constants
+// and the loop over the edges stored in the node unrolls. Words are taken as string_views,
+// so they don't have to be nul terminated or copied to add the terminator.
+//
+//    tk::WordList<> words;                 // the WordListNode struct format
+//    if (words.Open( data, size )) {       // the bytes of a wordtool file
+//        bool found = words.Contains( "scalawag" );
+//    }
+//
+// Use tk::WordList<u32> for a file packed with 4 byte indices, tk::WordList<tk::Index24>
+// for 3 bytes, and the Layout parameter for wordtool --align. Open fails if the file was
+// packed some other way, wordtool prints the format it used. Files with --child-labels
+// are only supported by the C API.
+//
+// Everything works in constant expressions, so a list built in with wordtool --emit=constexpr
+// can be checked at compile time:
+//
+//    static_assert( banned_words_list.Contains( "darn" ) );
+
+#include <cstddef>
+#include <string_view>
+
+extern "C" {
+#include "tk_wordlist.h"
+}
+
+namespace tk {
+
+// A 3 byte edge index, for wordtool --edge-index-size=3
+struct Index24 {
+    u8 bytes[3];
+};
+
+// How the nodes are laid out, wordtool --align=8 or --align=16 for the aligned ones
+enum class Layout {
+    Packed = 0,
+    Aligned8 = 8,
+    Aligned16 = 16,
+};
+
+template <typename IndexT = edgeIndex_t, int EdgeLimit = EDGE_LIMIT, Layout NodeLayout = Layout::Packed>
+class WordList {
+public:
+    static constexpr int kIndexSize = (int)sizeof(IndexT);
+    static constexpr int kLabelSize = 4;
+    static constexpr int kEdgesOffset = (NodeLayout == Layout::Packed) ? kLabelSize + 1 :
+                                        (kLabelSize + 1 + kIndexSize - 1) / kIndexSize * kIndexSize;
+    static constexpr int kNodeSize = (NodeLayout == Layout::Packed) ? kEdgesOffset + EdgeLimit * kIndexSize :
+                                     (int)NodeLayout;
+
+    static_assert( (kIndexSize >= 2) && (kIndexSize <= 4), "edge indices are 2, 3 or 4 bytes" );
+    static_assert( (NodeLayout == Layout::Packed) || (kIndexSize != 3), "aligned nodes need 2 or 4 byte indices" );
+    static_assert( (NodeLayout == Layout::Packed) || (EdgeLimit == (kNodeSize - kEdgesOffset) / kIndexSize),
+                   "EdgeLimit has to be what fits in an aligned node" );
+
+    WordList() = default;
+
+    // A WordListNode array, like WordList_Lookup takes. Only for the default format.
+    explicit WordList( const WordListNode *nodes ) : m_nodes( (const u8*)nodes )
+    {
+        static_assert( (kNodeSize == sizeof(WordListNode)) && (kIndexSize == sizeof(edgeIndex_t)) &&
+                       (EdgeLimit == EDGE_LIMIT) && (NodeLayout == Layout::Packed),
+                       "WordListNode arrays are only in the default format" );
+    }
+
+    // The bytes of a wordtool file, read or mapped into memory. The data isn't copied so it
+    // has to stay around. Returns false if it isn't a word list in this format, see Error().
+    bool Open( const void *data, size_t size )
+    {
+        return OpenBytes( (const u8*)data, size );
+    }
+
+    // Same as Open, but this works at compile time on a constexpr array, like the ones
+    // from wordtool --emit=constexpr. Check IsOpen() on the result.
+    static constexpr WordList FromBytes( const u8 *data, size_t size )
+    {
+        WordList wordlist;
+        wordlist.OpenBytes( data, size );
+        return wordlist;
+    }
+
+    // A list opened with WordList_Open, for when tk_wordlist.c is linked in anyway
+    bool Open( const ::WordList &wordlist )
+    {
+        if (!wordlist.header) {
+            return Fail( "word list isn't open" );
+        }
+        return Open( wordlist.header, wordlist.header->fileSize ? wordlist.header->fileSize :
+                     wordlist.header->nodesOffset + (size_t)wordlist.numNodes * wordlist.format.nodeSize );
+    }
+
+    constexpr bool IsOpen() const { return m_nodes != nullptr; }
+    constexpr u32 NumNodes() const { return m_numNodes; }
+    constexpr const char *Error() const { return m_error; }
+
+    constexpr bool Contains( std::string_view word ) const
+    {
+        if ((!m_nodes) || (word.size() + 2 > MAX_WORD_LENGTH)) {
+            return false;
+        }
+
+        // Go down until we've matched all of the word plus the terminator. A label can't
+        // go past the terminator since the window is nul padded after it.
+        const char *chars = word.data();
+        size_t len = word.size();
+        const u8 *curr = m_nodes;
+        size_t pos = LabelLen( curr );
+        while (pos <= len) {
+            curr = FindChild( curr, Window( chars, len, pos ) );
+            if (!curr) {
+                return false;
+            }
+            pos += LabelLen( curr );
+        }
+        return true;
+    }
+
+    constexpr bool Contains( const char *word, size_t len ) const
+    {
+        return Contains( std::string_view( word, len ) );
+    }
+
+private:
+    // The header is read a byte at a time so this works in a constant expression
+    static constexpr u32 HeaderField( const u8 *data, size_t offset, int size )
+    {
+        u32 value = 0;
+        for (int i=size-1; i >= 0; i--) {
+            value = (value << 8) | data[offset + i];
+        }
+        return value;
+    }
+
+    constexpr bool OpenBytes( const u8 *data, size_t size )
+    {
+        m_nodes = nullptr;
+        m_numNodes = 0;
+        if (size < sizeof(WordListHeader)) {
+            return Fail( "not a word list file" );
+        }
+        for (int i=0; i < 4; i++) {
+            if (data[i] != (u8)WORDLIST_MAGIC[i]) {
+                return Fail( "not a word list file" );
+            }
+        }
+        u32 headerSize = HeaderField( data, offsetof(WordListHeader, headerSize), 2 );
+        if ((HeaderField( data, offsetof(WordListHeader, version), 2 ) != WORDLIST_VERSION) ||
+            (headerSize < sizeof(WordListHeader))) {
+            return Fail( "unsupported word list version" );
+        }
+        u32 labelSize = HeaderField( data, offsetof(WordListHeader, labelSize), 1 );
+        u32 edgesOffset = HeaderField( data, offsetof(WordListHeader, edgesOffset), 1 );
+        if (!edgesOffset) {
+            edgesOffset = labelSize + 1;
+        }
+        if ((HeaderField( data, offsetof(WordListHeader, edgeIndexSize), 1 ) != kIndexSize) ||
+            (HeaderField( data, offsetof(WordListHeader, edgeLimit), 1 ) != EdgeLimit) ||
+            (HeaderField( data, offsetof(WordListHeader, nodeSize), 1 ) != kNodeSize) ||
+            (HeaderField( data, offsetof(WordListHeader, childLabels), 1 ) != 0) ||
+            (labelSize != kLabelSize) || (edgesOffset != kEdgesOffset)) {
+            return Fail( "word list was packed in a different format" );
+        }
+        u32 numNodes = HeaderField( data, offsetof(WordListHeader, numNodes), 4 );
+        u32 nodesOffset = HeaderField( data, offsetof(WordListHeader, nodesOffset), 4 );
+        if ((numNodes == 0) || (nodesOffset < headerSize) || (nodesOffset + (size_t)numNodes * kNodeSize > size)) {
+            return Fail( "word list file is truncated" );
+        }
+        m_nodes = data + nodesOffset;
+        m_numNodes = numNodes;
+        m_error = nullptr;
+        return true;
+    }
+
+    // Compilers turn this into a single load
+    template <typename T>
+    static constexpr u32 LoadU32( const T *bytes )
+    {
+        return (u32)(u8)bytes[0] | ((u32)(u8)bytes[1] << 8) | ((u32)(u8)bytes[2] << 16) | ((u32)(u8)bytes[3] << 24);
+    }
+
+    static constexpr u32 LoadEdge( const u8 *node, int i )
+    {
+        const u8 *edge = node + kEdgesOffset + i*kIndexSize;
+        if constexpr (kIndexSize == 2) {
+            return edge[0] | (edge[1] << 8);
+        } else if constexpr (kIndexSize == 3) {
+            return edge[0] | (edge[1] << 8) | ((u32)edge[2] << 16);
+        } else {
+            return LoadU32( edge );
+        }
+    }
+
+    static constexpr size_t LabelLen( const u8 *node )
+    {
+        u32 label = LoadU32( node );
+        return (label & 0xFF) ? (label & 0xFF00) ? (label & 0xFF0000) ? (label & 0xFF000000) ? 4 : 3 : 2 : 1 : 0;
+    }
+
+    // The next four bytes of the word with the terminator after it, nul padded
+    static constexpr u32 Window( const char *chars, size_t len, size_t pos )
+    {
+        if (pos + 4 <= len) {
+            return LoadU32( chars + pos );
+        }
+        u8 buff[4] = { 0, 0, 0, 0 };
+        for (size_t i=0; (i < 4) && (pos + i <= len); i++) {
+            buff[i] = (pos + i < len) ? chars[pos + i] : '*';
+        }
+        return LoadU32( buff );
+    }
+
+    // Same rule as the C matcher, every byte of the label is either the nul
+    // padding or the same as the window.
+    static constexpr bool LabelMatches( u32 label, u32 window )
+    {
+        u32 used = label | (label >> 4);
+        used |= used >> 2;
+        used |= used >> 1;
+        used = (used & 0x01010101u) * 0xFF;
+        return ((label ^ window) & used) == 0;
+    }
+
+    constexpr const u8 *FindChild( const u8 *node, u32 window ) const
+    {
+        int numEdges = node[kLabelSize];
+        for (int i=0; i < EdgeLimit; i++) {
+            if (i >= numEdges) {
+                return nullptr;
+            }
+            const u8 *child = m_nodes + (size_t)LoadEdge( node, i ) * kNodeSize;
+            if (LabelMatches( LoadU32( child ), window )) {
+                return child;
+            }
+        }
+        // The rest spill over into the following nodes
+        for (int i=EdgeLimit; i < numEdges; i++) {
+            const u8 *child = m_nodes + (size_t)LoadEdge( node, i ) * kNodeSize;
+            if (LabelMatches( LoadU32( child ), window )) {
+                return child;
+            }
+        }
+        return nullptr;
+    }
+
+    constexpr bool Fail( const char *error )
+    {
+        m_nodes = nullptr;
+        m_numNodes = 0;
+        m_error = error;
+        return false;
+    }
+
+    const u8 *m_nodes = nullptr;
+    u32 m_numNodes = 0;
+    const char *m_error = nullptr;
+};
+
+} // namespace tk
+
+#endif
@@ -1,6 +1,27 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <limits.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 extern "C" {
 #include "tk_wordlist.h"
@@ -18,64 +39,103 @@ Usage:
 #define MEGABYTE (1024*1024)
 #define WORDBUFFSZ (10*MEGABYTE)
 
-// This is our piggy radix-prefix-trie used for building, this gets packed into the
-// much more space-efficient WordList
-// https://en.wikipedia.org/wiki/Radix_tree
-#define MAX_EDGES 30
-
-struct TrieNode;
+// Everything in the trie comes from one arena, so the nodes are cheap to allocate and
+// can all be released at once when we're done
+#define ARENA_BLOCK_SIZE (MEGABYTE)
 
-struct TrieNode {
-    uint32_t nodeId;
-    WordListNode *packNode;
-	char label[MAX_WORD_LENGTH];
-	int numEdges;
-	TrieNode *edge[MAX_EDGES];
-    
-    uint64_t hashcode;
-    int nodeCount;
-    bool visited;
-    int dupeCount;
-    bool dupeProcessed;
+struct Arena {
+    std::vector<uint8_t*> blocks;
+    size_t blockUsed;
+    size_t bytesUsed;       // handed out
+    size_t bytesReserved;   // in all the blocks
 };
 
-#define HASHTABLESIZE (11177)
-struct CountTableEntry {
-    uint64_t hashcode;
-    uint32_t nodeCount;
-    TrieNode *node; // any one node that matches the hash code
-    CountTableEntry *next;
-};
+Arena g_arena;
 
-CountTableEntry *CountTableEntry_Lookup( CountTableEntry **countHash, TrieNode *node, bool addIfNotPresent )
+// The arena for this thread, shards built with -j each have their own
+thread_local Arena *t_arena = &g_arena;
+
+void *Arena_Alloc( Arena *arena, size_t size )
 {
-    int ndx = node->hashcode % HASHTABLESIZE;
-    CountTableEntry *entry = countHash[ndx];
-    CountTableEntry **whereToAdd = &(countHash[ndx]);
-    
-    // See if we find our hash code
-    while (entry) {
-        if (entry->hashcode == node->hashcode) {
-            return entry;
+    size = (size + 7) & ~(size_t)7;
+    if (arena->blocks.empty() || (arena->blockUsed + size > ARENA_BLOCK_SIZE)) {
+        size_t blockSize = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+        uint8_t *block = (uint8_t*)malloc( blockSize );
+        if (!block) {
+            printf("ERROR Out of memory\n");
+            exit(1);
         }
-        whereToAdd = &(entry->next);
-        entry = entry->next;
+        arena->blocks.push_back( block );
+        arena->blockUsed = 0;
+        arena->bytesReserved += blockSize;
     }
-    
-    if (!addIfNotPresent) {
-        return NULL;
+    void *result = arena->blocks.back() + arena->blockUsed;
+    arena->blockUsed += size;
+    arena->bytesUsed += size;
+    return result;
+}
+
+void Arena_Release( Arena *arena )
+{
+    for (size_t i=0; i < arena->blocks.size(); i++) {
+        free( arena->blocks[i] );
     }
-    
-    // Add if not present
-    entry = (CountTableEntry*)malloc(sizeof(CountTableEntry));
-    memset( entry, 0, sizeof(CountTableEntry));
-    entry->hashcode = node->hashcode;
-    entry->node = node;
-    *whereToAdd = entry;
+    arena->blocks.clear();
+    arena->blockUsed = 0;
+    arena->bytesUsed = 0;
+    arena->bytesReserved = 0;
+}
 
-    return entry;
+// Biggest the process got, in bytes, 0 if we can't tell
+size_t PeakMemoryBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof(counters) )) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage( RUSAGE_SELF, &usage ) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
 }
 
+// This is our radix-prefix-trie used for building, this gets packed into the
+// much more space-efficient WordList
+// https://en.wikipedia.org/wiki/Radix_tree
+struct TrieNode;
+
+struct TrieNode {
+    char *label;        // in the arena, labels only get shorter so they're edited in place
+    TrieNode **edge;    // in the arena, grows as edges are added
+    uint8_t numEdges;
+    uint8_t maxEdges;
+    bool packed;        // packIndex has been assigned
+    uint8_t dedupePass; // last TrieNode_Dedupe pass that got to this node
+    bool maxWeightDone;
+    bool lettersDone;
+    uint8_t minLength;  // fewest letters from the start of this label to the end of a word
+    uint8_t maxLength;  // and the most, 0 if not computed yet
+    uint32_t nodeId;
+    uint32_t packIndex; // where this goes in the packed nodes
+    int height;         // longest path to a leaf, 0 if not computed yet
+    
+    uint64_t hashcode;
+    int nodeCount;
+    uint32_t wordCount; // words below this node, 0 if not counted yet
+    uint32_t weight;    // for leaves, the weight of the word that ends here
+    uint32_t maxWeight; // biggest weight of any word below this node
+    uint32_t letters;   // bit for each letter used from this label down
+};
+
 bool startsWith( const char *prefix, const char *str )
 {
 	int prefixLen = strlen( prefix );
@@ -124,18 +184,53 @@ void TrieNode_PrintWords( TrieNode *curr, char *word )
 	}	
 }
 
-int g_nodeCount = 0;
+std::atomic<int> g_nodeCount( 0 );
 
-TrieNode *TrieNode_Alloc( const char *name )
+TrieNode *TrieNode_Alloc( const char *label, size_t labelLen )
 {
-    g_nodeCount++;
-    
-	TrieNode *node = (TrieNode*)malloc(sizeof(TrieNode));
+	TrieNode *node = (TrieNode*)Arena_Alloc( t_arena, sizeof(TrieNode) );
 	memset( node, 0, sizeof(TrieNode) );
-	//strcpy( node->name, name );
+	node->nodeId = ++g_nodeCount;
+	node->label = (char*)Arena_Alloc( t_arena, labelLen + 1 );
+	memcpy( node->label, label, labelLen );
+	node->label[labelLen] = '\0';
 	return node;
 }
 
+// Edge lists that were outgrown, by size, so they can be reused
+#define MAX_EDGE_LIST_SIZES (8)
+thread_local TrieNode **t_freeEdgeLists[MAX_EDGE_LIST_SIZES];
+
+void TrieNode_AddEdge( TrieNode *node, TrieNode *child )
+{
+    if (node->numEdges == node->maxEdges) {
+        if (node->maxEdges == 128) {
+            printf("ERROR Too many edges on node '%s'\n", node->label );
+            exit(1);
+        }
+        int sizeClass = 0;
+        while ((2 << sizeClass) <= node->maxEdges) {
+            sizeClass++;
+        }
+        int maxEdges = 2 << sizeClass;
+        TrieNode **edges = t_freeEdgeLists[sizeClass];
+        if (edges) {
+            t_freeEdgeLists[sizeClass] = (TrieNode**)edges[0];
+        } else {
+            edges = (TrieNode**)Arena_Alloc( t_arena, maxEdges * sizeof(TrieNode*) );
+        }
+        if (node->numEdges) {
+            memcpy( edges, node->edge, node->numEdges * sizeof(TrieNode*) );
+            TrieNode **oldEdges = node->edge;
+            oldEdges[0] = (TrieNode*)t_freeEdgeLists[sizeClass-1];
+            t_freeEdgeLists[sizeClass-1] = oldEdges;
+        }
+        node->edge = edges;
+        node->maxEdges = (uint8_t)maxEdges;
+    }
+    node->edge[node->numEdges++] = child;
+}
+
 void TrieNode_Print( TrieNode *curr, int depth )
 {
 	const char *spc = "...........................";
@@ -151,14 +246,6 @@ void TrieNode_Print( TrieNode *curr, int depth )
 	}
 }
 
-void TrieNode_Label( TrieNode *curr, uint32_t *counter )
-{
-    curr->nodeId = (*counter)++;
-    for (int i=0; i < curr->numEdges; i++) {
-        TrieNode_Label( curr->edge[i], counter );
-    }
-}
-
 void TrieNode_Graphviz( TrieNode *curr, FILE *fp )
 {
     //fprintf( fp, " %d [label=\"%s %X\"];\n", curr->nodeId,curr->label, curr->hashcode );
@@ -187,7 +274,8 @@ void TrieNode_WordList( TrieNode *curr, char *prefix )
     }
 }
 
-void TrieNode_Insert( TrieNode *root, char *origWord )
+// Returns the leaf node for the word
+TrieNode *TrieNode_Insert( TrieNode *root, char *origWord )
 {
     //printf("---- Insert: %s ----\n", origWord  );
     
@@ -228,25 +316,25 @@ void TrieNode_Insert( TrieNode *root, char *origWord )
         // If this is a leaf, add a dummy to end the word
         if ((node!=root) && (node->numEdges==0)) {
 //            printf ("Adding leaf\n");
-            TrieNode *leafEdge = TrieNode_Alloc( "leaf" );
-            node->edge[node->numEdges++] = leafEdge;
+            TrieNode *leafEdge = TrieNode_Alloc( "", 0 );
+            leafEdge->weight = node->weight;
+            TrieNode_AddEdge( node, leafEdge );
         }
         
-        TrieNode *newEdge = TrieNode_Alloc( "nosplit" );
-        strcpy(newEdge->label, suffix );
-        node->edge[node->numEdges++] = newEdge;
+        TrieNode *newEdge = TrieNode_Alloc( suffix, strlen( suffix ) );
+        TrieNode_AddEdge( node, newEdge );
+        return newEdge;
     } else {
 //        printf("Split Edge ...\n");
-        TrieNode *splitEdge = TrieNode_Alloc( "split1" );
+        TrieNode *splitEdge = TrieNode_Alloc( suffix, longestSharedPrefixLen );
 
         // If the whole split edge is shared, add a leaf node to ensure this word is still counted
 //        printf("Len suffix %zu longest %d\n", strlen(suffix), longestSharedPrefixLen);
 //        if ( (int)strlen(suffix) == longestSharedPrefixLen) {
 //            printf ("Adding leaf\n");
-//            TrieNode *leafEdge = TrieNode_Alloc( "leaf" );
-//            splitEdge->edge[splitEdge->numEdges++] = leafEdge;
+//            TrieNode *leafEdge = TrieNode_Alloc( "", 0 );
+//            TrieNode_AddEdge( splitEdge, leafEdge );
 //        }
-        strncpy(splitEdge->label, suffix, longestSharedPrefixLen );
         
         TrieNode *oldEdge = node->edge[longestSharedPrefixIndex];
         node->edge[longestSharedPrefixIndex] = splitEdge;
@@ -255,13 +343,12 @@ void TrieNode_Insert( TrieNode *root, char *origWord )
         strcpy( buff, oldEdge->label + longestSharedPrefixLen );
         strcpy( oldEdge->label, buff );
         
-        splitEdge->edge[splitEdge->numEdges++] = oldEdge;
+        TrieNode_AddEdge( splitEdge, oldEdge );
         
-        TrieNode *newEdge = TrieNode_Alloc( "split2" );
-        strcpy( newEdge->label, suffix + longestSharedPrefixLen );
-        splitEdge->edge[splitEdge->numEdges++] = newEdge;
+        TrieNode *newEdge = TrieNode_Alloc( suffix + longestSharedPrefixLen, strlen( suffix + longestSharedPrefixLen ) );
+        TrieNode_AddEdge( splitEdge, newEdge );
+        return newEdge;
     }
-    
 }
 
 int nodeLabelCmp( const void *a,const void *b ) {
@@ -297,9 +384,8 @@ void TrieNode_SplitLongNodes( TrieNode *curr, int maxLen )
             strcpy( edge->label, suffix );
             
             // Replace the edge we split
-            TrieNode *splitEdge = TrieNode_Alloc( "splitedge" );
-            strcpy( splitEdge->label, prefix );
-            splitEdge->edge[splitEdge->numEdges++] = edge;
+            TrieNode *splitEdge = TrieNode_Alloc( prefix, maxLen );
+            TrieNode_AddEdge( splitEdge, edge );
             curr->edge[i] = splitEdge;
         }
     }
@@ -332,287 +418,1825 @@ void TrieNode_GatherStats( TrieNode *curr, TrieStats *stats ) {
     }
 }
 
-int calcNumPackNodes(int numEdges ) {
-    int extraEdges = 0;
-    if (numEdges > EDGE_LIMIT) {
-        extraEdges = numEdges - EDGE_LIMIT;
+// Chars per label and edges per packed node, set with --label-size and --edge-limit
+// or picked by --tune. The data file says what they are, so the runtime reads any of them.
+int g_labelSize = 4;
+int g_edgeLimit = EDGE_LIMIT;
+
+// Node format for the packed data with a given edge index size. nodeAlign is 0 for
+// the packed layout, or 8 or 16 to pad the nodes and align the edge indices.
+WordListFormat MakePackFormat( int edgeIndexSize, int nodeAlign, bool childLabels )
+{
+    WordListFormat format = {};
+    format.labelSize = g_labelSize;
+    format.edgeIndexSize = edgeIndexSize;
+    format.childLabels = childLabels ? 1 : 0;
+    if (nodeAlign) {
+        format.edgesOffset = ((format.labelSize + 1) + (edgeIndexSize-1)) / edgeIndexSize * edgeIndexSize;
+        format.nodeSize = nodeAlign;
+        format.edgeLimit = (format.nodeSize - format.edgesOffset) / edgeIndexSize;
+    } else {
+        format.edgesOffset = format.labelSize + 1;
+        format.edgeLimit = g_edgeLimit;
+        format.nodeSize = format.edgesOffset + format.edgeLimit * edgeIndexSize;
     }
-    // 1 for the edge node, plus extra if it needs more space for edges
-    int numPackNodes = 1 + (((sizeof(u32)*(extraEdges)) + (sizeof(WordListNode)-1)) / sizeof(WordListNode));
-    return numPackNodes;
+    return format;
 }
 
-// Assumes buffer is prefilled with zeros
-WordListNode *_baseNode;
-void PackWordList( TrieNode *node, WordListNode *packNode, WordListNode **nextPackNode )
+// Bytes used by a node with this many edges, including any that spill into the following nodes
+int calcPackNodeBytes( const WordListFormat &format, int numEdges ) {
+    int numBytes = format.edgesOffset + numEdges * format.edgeIndexSize;
+    if (format.childLabels) {
+        numBytes = ((numBytes + 3) & ~3) + numEdges * 4;
+    }
+    return numBytes;
+}
+
+int calcNumPackNodes( const WordListFormat &format, int numEdges ) {
+    // 1 for the node itself, plus extra if it needs more space for edges
+    int numBytes = calcPackNodeBytes( format, numEdges );
+    int numPackNodes = (numBytes + format.nodeSize - 1) / format.nodeSize;
+    return numPackNodes < 1 ? 1 : numPackNodes;
+}
+
+void TrieNode_ClearPacked( TrieNode *curr )
+{
+    curr->packed = false;
+    for (int i=0; i < curr->numEdges; i++) {
+        TrieNode_ClearPacked( curr->edge[i] );
+    }
+}
+
+// ----------------------------------------------------------------------
+// Node layout
+//
+// The order the nodes go in the packed data doesn't matter for correctness, but
+// it decides how many cache lines a lookup touches. A lookup reads each node on
+// the path plus the labels of all of its children.
+// ----------------------------------------------------------------------
+enum PackLayoutType {
+    PackLayout_DFS,     // depth first, children placed together when we first visit a node
+    PackLayout_BFS,     // level order, so the top few levels are contiguous
+    PackLayout_VEB,     // van Emde Boas style, recursively split into top and bottom halves
+    PackLayout_Cluster, // depth first, but keep each node's children in one cache line
+
+    PackLayout_COUNT
+};
+
+const char *g_packLayoutNames[PackLayout_COUNT] = { "dfs", "bfs", "veb", "cluster" };
+
+#define CACHE_LINE_SIZE (64)
+
+void PlaceNode( TrieNode *node, const WordListFormat &format, uint32_t *nextPackIndex )
+{
+    if (!node->packed) {
+        node->packIndex = *nextPackIndex;
+        node->packed = true;
+        *nextPackIndex += calcNumPackNodes( format, node->numEdges );
+    }
+}
+
+void AssignPackIndicesDFS( TrieNode *node, const WordListFormat &format, uint32_t *nextPackIndex )
 {
-    // Pack this node
-    strncpy( packNode->label, node->label, 4 );
-    packNode->numEdges = node->numEdges;
-    
     // Now allocate space for our edge node
     for (int i=0; i < node->numEdges; i++) {
-        if (node->edge[i]->packNode == NULL) {
-            node->edge[i]->packNode = *nextPackNode;
-            int numPackNodes = calcNumPackNodes(node->edge[i]->numEdges );
-            //printf("Edges %d extra pack nodes: %d\n", numEdges, numPackNodes );
-            *nextPackNode += numPackNodes;
-        }
+        PlaceNode( node->edge[i], format, nextPackIndex );
     }
     
     // Now pack child nodes
     for (int i=0; i < node->numEdges; i++) {
-        PackWordList( node->edge[i], node->edge[i]->packNode, nextPackNode );
+        AssignPackIndicesDFS( node->edge[i], format, nextPackIndex );
     }
 }
 
-void AssignWordlistIndices( WordListNode *base, TrieNode *curr, int *highestIndex )
+void AssignPackIndicesBFS( TrieNode *root, const WordListFormat &format, uint32_t *nextPackIndex )
 {
-    WordListNode *packNode = curr->packNode;
-//    printf("FixupWordlistIndices: %d '%s' (packed %d) edges %d\n",
-//           curr->nodeId, curr->label,
-//           packNode - base, packNode->numEdges );
-    for (int i=0; i < packNode->numEdges; i++) {
-        // edge index for pack node
-//        printf ("curr numedges %d pacnode numEdgs %d -- i %d\n",
-//                curr->numEdges, packNode->numEdges, i );
-        int ndx = curr->edge[i]->packNode - base;
-        packNode->edge[i] = ndx;
-        if (ndx > *highestIndex) {
-            *highestIndex = ndx;
+    std::vector<TrieNode*> queue;
+    queue.push_back( root );
+    for (size_t q=0; q < queue.size(); q++) {
+        TrieNode *node = queue[q];
+        for (int i=0; i < node->numEdges; i++) {
+            if (!node->edge[i]->packed) {
+                PlaceNode( node->edge[i], format, nextPackIndex );
+                queue.push_back( node->edge[i] );
+            }
         }
     }
-    
-    for (int i=0; i < packNode->numEdges; i++) {
-        AssignWordlistIndices( base, curr->edge[i], highestIndex );
+}
+
+int TrieNode_Height( TrieNode *curr )
+{
+    if (curr->height == 0) {
+        curr->height = 1;
+        for (int i=0; i < curr->numEdges; i++) {
+            int edgeHeight = TrieNode_Height( curr->edge[i] ) + 1;
+            if (edgeHeight > curr->height) {
+                curr->height = edgeHeight;
+            }
+        }
     }
+    return curr->height;
 }
 
-// Update the hash and count
-uint64_t TrieNode_UpdateHash( TrieNode *curr )
+// Nodes exactly 'depth' edges below curr that aren't placed yet
+void CollectFrontier( TrieNode *curr, int depth, std::vector<TrieNode*> &frontier )
 {
-    // Hash is kind of dumb, just djb-hash the label and then add all of the child nodes
-    uint64_t hash = 5381;
-    for (char *ch=curr->label; *ch; ch++) {
-        hash = ((hash << 5) + hash) + *ch;
+    if (depth == 0) {
+        if (!curr->packed) {
+            frontier.push_back( curr );
+        }
+        return;
     }
-    curr->nodeCount = 1; // count ourself
     for (int i=0; i < curr->numEdges; i++) {
-        uint64_t edgeHash = TrieNode_UpdateHash( curr->edge[i] );
-        curr->nodeCount += curr->edge[i]->nodeCount;
-        //hash += edgeHash;
-        hash = ((hash << 5) + hash) + edgeHash;
+        CollectFrontier( curr->edge[i], depth-1, frontier );
     }
-    curr->hashcode = hash;
-    return hash;
 }
 
-void TrieNode_ClearVisited( TrieNode *curr ) {
-    curr->visited = false;
-    for (int i=0; i < curr->numEdges; i++) {
-        TrieNode_ClearVisited( curr->edge[i] );
+// Lay out the top half of the levels under node, then each subtree hanging
+// off the bottom of that, recursively. Shared nodes go wherever we see them first.
+void AssignPackIndicesVEB( TrieNode *node, int height, const WordListFormat &format, uint32_t *nextPackIndex )
+{
+    if (height <= 1) {
+        PlaceNode( node, format, nextPackIndex );
+        return;
+    }
+    int topHeight = height / 2;
+    int bottomHeight = height - topHeight;
+    AssignPackIndicesVEB( node, topHeight, format, nextPackIndex );
+
+    std::vector<TrieNode*> frontier;
+    CollectFrontier( node, topHeight, frontier );
+    for (size_t i=0; i < frontier.size(); i++) {
+        AssignPackIndicesVEB( frontier[i], bottomHeight, format, nextPackIndex );
     }
 }
 
-bool TrieNode_CompareSubtrees( TrieNode *left, TrieNode *right, int depth ) {
-    
-    //printf("CompareSubtrees %p %p -- depth %d\n", left, right, depth );
-
-    if (depth > MAX_WORD_LENGTH) {
-        printf("Max depth reached...\n");
-        exit(1);
+// Like DFS, but a node's children are kept in the same cache line when they'd
+// fit in one, by skipping ahead to the next line when they would straddle it.
+// The skipped nodes are left empty, so this costs some space.
+void AssignPackIndicesCluster( TrieNode *node, const WordListFormat &format, size_t nodesOffset, uint32_t *nextPackIndex )
+{
+    int groupSlots = 0;
+    for (int i=0; i < node->numEdges; i++) {
+        if (!node->edge[i]->packed) {
+            groupSlots += calcNumPackNodes( format, node->edge[i]->numEdges );
+        }
+    }
+    if (groupSlots > 0) {
+        size_t groupBytes = (size_t)groupSlots * format.nodeSize;
+        size_t start = nodesOffset + (size_t)(*nextPackIndex) * format.nodeSize;
+        size_t lineLeft = CACHE_LINE_SIZE - (start % CACHE_LINE_SIZE);
+        if ((groupBytes <= CACHE_LINE_SIZE) && (groupBytes > lineLeft)) {
+            *nextPackIndex += (lineLeft + format.nodeSize - 1) / format.nodeSize;
+        }
     }
 
-    if (strcmp( left->label, right->label)) {
-        return false;
+    for (int i=0; i < node->numEdges; i++) {
+        PlaceNode( node->edge[i], format, nextPackIndex );
     }
+    for (int i=0; i < node->numEdges; i++) {
+        AssignPackIndicesCluster( node->edge[i], format, nodesOffset, nextPackIndex );
+    }
+}
 
-    if (left->numEdges != right->numEdges) {
-        return false;
+// Returns the number of pack nodes needed
+uint32_t PackLayout( TrieNode *root, const WordListFormat &format, PackLayoutType layout )
+{
+    TrieNode_ClearPacked( root );
+    root->packIndex = 0;
+    root->packed = true;
+    uint32_t numPackNodes = calcNumPackNodes( format, root->numEdges );
+    switch (layout) {
+        case PackLayout_BFS:
+            AssignPackIndicesBFS( root, format, &numPackNodes );
+            break;
+        case PackLayout_VEB:
+            AssignPackIndicesVEB( root, TrieNode_Height( root ), format, &numPackNodes );
+            break;
+        case PackLayout_Cluster:
+            AssignPackIndicesCluster( root, format, sizeof(WordListHeader), &numPackNodes );
+            break;
+        default:
+            AssignPackIndicesDFS( root, format, &numPackNodes );
+            break;
     }
-    for (int i=0; i < left->numEdges; i++) {
-        bool subtreesMatch = TrieNode_CompareSubtrees( left->edge[i], right->edge[i], depth+1 );
-        if (!subtreesMatch) {
-            return false;
+    return numPackNodes;
+}
+
+// Distinct cache lines touched on the way to each word, to compare the layouts.
+// This assumes nothing is in the cache to start with.
+#define MAX_LOOKUP_LINES (1024)
+struct CacheLineCounter {
+    uint32_t lines[MAX_LOOKUP_LINES];
+    int numLines;
+    uint64_t totalLines;
+    uint32_t numWords;
+};
+
+void CacheLineCounter_Touch( CacheLineCounter *counter, size_t offset, size_t size )
+{
+    for (size_t line = offset / CACHE_LINE_SIZE; line <= (offset + size - 1) / CACHE_LINE_SIZE; line++) {
+        bool found = false;
+        for (int i=0; i < counter->numLines; i++) {
+            if (counter->lines[i] == line) {
+                found = true;
+                break;
+            }
+        }
+        if ((!found) && (counter->numLines < MAX_LOOKUP_LINES)) {
+            counter->lines[counter->numLines++] = (uint32_t)line;
         }
     }
-    return true;
 }
 
-uint32_t TrieNode_CountDupes( TrieNode *curr, TrieNode *target ) {
-    
-    curr->visited = true;
-    uint32_t count = 0;
-    
+void CountCacheLines( TrieNode *curr, const WordListFormat &format, size_t nodesOffset, CacheLineCounter *counter )
+{
+    int savedNumLines = counter->numLines;
+
+    // The node itself and its edges, then each child's label if they aren't in the node
+    size_t nodeOffset = nodesOffset + (size_t)curr->packIndex * format.nodeSize;
+    CacheLineCounter_Touch( counter, nodeOffset, calcPackNodeBytes( format, curr->numEdges ) );
+    for (int i=0; (i < curr->numEdges) && (!format.childLabels); i++) {
+        size_t edgeOffset = nodesOffset + (size_t)curr->edge[i]->packIndex * format.nodeSize;
+        CacheLineCounter_Touch( counter, edgeOffset, format.labelSize );
+    }
+
+    if (curr->numEdges == 0) {
+        counter->totalLines += counter->numLines;
+        counter->numWords++;
+    }
     for (int i=0; i < curr->numEdges; i++) {
-        if (!curr->edge[i]->visited) {
-            count += TrieNode_CountDupes( curr->edge[i], target );
-        }
+        CountCacheLines( curr->edge[i], format, nodesOffset, counter );
     }
-    
-    
-    if ((curr != target) && (curr->hashcode == target->hashcode)) {
-        // Make sure it's actually a dupe
-        if (TrieNode_CompareSubtrees( curr, target, 0)) {
-            count++;
-        }
-        //printf("CountDupes: %d ( %d/%0X, %d/%0X)\n", count, curr->nodeId, curr->hashcode, target->nodeId,target->hashcode );
-    }    
-    
-    return count;
+    counter->numLines = savedNumLines;
 }
 
-TrieNode *TrieNode_FindMostDuplicated( TrieNode *root, TrieNode *curr ) {
-    
-    static int blah = 0;
-    blah++;
-    if ((blah % 100) == 0) {
-        printf("]] %d\n", blah );
-    }
-    // How much is this node duplicated?
-    TrieNode_ClearVisited(root);
-    uint32_t bestCount = TrieNode_CountDupes( root, curr );
-    TrieNode *bestNode = curr;
-    
-    //printf("Node %d (%s) dupes %d\n", curr->nodeId, curr->label, bestCount );
-    for (int i=0; i < curr->numEdges; i++) {
-        //uint32_t edgeCount = TrieNode_CountDupes( root, curr->edge[i] );
-        TrieNode *edgeMostDup = TrieNode_FindMostDuplicated( root, curr->edge[i] );
-      //  printf("EdgeCount %d\n", edgeMostDup->dupeCount );
-        if (edgeMostDup->dupeCount > bestCount) {
-            bestNode = edgeMostDup;
-            bestCount = edgeMostDup->dupeCount;
-        }
+float AverageCacheLinesPerLookup( TrieNode *root, const WordListFormat &format, size_t nodesOffset )
+{
+    CacheLineCounter *counter = (CacheLineCounter*)malloc( sizeof(CacheLineCounter) );
+    memset( counter, 0, sizeof(CacheLineCounter) );
+    CountCacheLines( root, format, nodesOffset, counter );
+    float result = (float)counter->totalLines / (float)counter->numWords;
+    free( counter );
+    return result;
+}
+
+void WritePackEdge( uint8_t *edge, uint32_t ndx, int edgeIndexSize )
+{
+    // little-endian
+    for (int i=0; i < edgeIndexSize; i++) {
+        edge[i] = (ndx >> (i*8)) & 0xFF;
     }
-    
-    bestNode->dupeCount = bestCount;
-    return bestNode;
 }
 
-void DoCountNodes( CountTableEntry **countTable, TrieNode * curr)
+// Assumes buffer is prefilled with zeros
+void PackWordList( TrieNode *curr, uint8_t *packData, const WordListFormat &format )
 {
-    CountTableEntry *ent = CountTableEntry_Lookup( countTable, curr, true );
-    if (!ent) {
-        printf("WARN: Lookup failed???\n");
+    uint8_t *packNode = packData + (size_t)curr->packIndex * format.nodeSize;
+    strncpy( (char*)packNode, curr->label, format.labelSize );
+    packNode[format.labelSize] = curr->numEdges;
+    for (int i=0; i < curr->numEdges; i++) {
+        WritePackEdge( packNode + format.edgesOffset + i*format.edgeIndexSize,
+                       curr->edge[i]->packIndex, format.edgeIndexSize );
+    }
+    if (format.childLabels) {
+        uint8_t *childLabels = packNode + ((format.edgesOffset + curr->numEdges*format.edgeIndexSize + 3) & ~3);
+        for (int i=0; i < curr->numEdges; i++) {
+            strncpy( (char*)childLabels + i*4, curr->edge[i]->label, 4 );
+        }
     }
-    
-    // Count ourself
-    curr->visited = true;
-    ent->nodeCount++;
-    //printf("DoCountNodes: node %d count is now %d\n", ent->node->nodeId, ent->nodeCount );
     
     for (int i=0; i < curr->numEdges; i++) {
-        TrieNode *edgeNode = curr->edge[i];
-        if (!edgeNode->visited) {
-            DoCountNodes( countTable, edgeNode );
-        }
+        PackWordList( curr->edge[i], packData, format );
     }
 }
 
-TrieNode *TrieNode_FindMostDuplicated2( CountTableEntry **countTable, TrieNode *root ) {
-    
-    // reset all counts in counttable
-    for (int i=0; i < HASHTABLESIZE; i++) {
-        CountTableEntry *ent = countTable[i];
-        while (ent) {
-            ent->nodeCount = 0;
-            ent = ent->next;
+// Counts the words reachable from here, each leaf ends one word. The count is
+// saved in each node, so a shared subtree is only walked once but still adds its
+// words to every parent that reaches it. Don't call this on an empty root, that
+// has no edges but isn't a word.
+uint32_t TrieNode_CountWords( TrieNode *curr )
+{
+    if (curr->wordCount == 0) {
+        if (curr->numEdges == 0) {
+            curr->wordCount = 1;
+        }
+        for (int i=0; i < curr->numEdges; i++) {
+            curr->wordCount += TrieNode_CountWords( curr->edge[i] );
         }
     }
-    
-    // Traverse and count nodes
-    TrieNode_ClearVisited(root );
-    DoCountNodes( countTable, root );
-    
-    // Get the node with the higest count
-    CountTableEntry *bestEntry = NULL;
-    for (int i=0; i < HASHTABLESIZE; i++) {
-        CountTableEntry *ent = countTable[i];
-
-        while (ent) {
-            if ((!bestEntry) || (ent->nodeCount > bestEntry->nodeCount)) {
-                // Sort of a hack.. 
-                if (!ent->node->dupeProcessed) {
-                    bestEntry = ent;
-                }
+    return curr->wordCount;
+}
+
+// Biggest weight of any word below here, this is what lets the autocomplete skip
+// subtrees that can't beat what it's already found.
+uint32_t TrieNode_UpdateMaxWeight( TrieNode *curr )
+{
+    if (!curr->maxWeightDone) {
+        curr->maxWeight = curr->weight;
+        for (int i=0; i < curr->numEdges; i++) {
+            uint32_t edgeWeight = TrieNode_UpdateMaxWeight( curr->edge[i] );
+            if (edgeWeight > curr->maxWeight) {
+                curr->maxWeight = edgeWeight;
             }
-            ent = ent->next;
         }
+        curr->maxWeightDone = true;
     }
-    
-    if (bestEntry) {
-        bestEntry->node->dupeCount = bestEntry->nodeCount;
-        bestEntry->node->dupeProcessed = true;
+    return curr->maxWeight;
+}
 
-        return bestEntry->node;
-    } else {
-        return NULL;
+// Shortest and longest words from here down, counting this node's label but not the terminator
+void TrieNode_UpdateLengths( TrieNode *curr )
+{
+    if (curr->maxLength) {
+        return;
+    }
+    int labelLen = strlen( curr->label );
+    if ((labelLen > 0) && (curr->label[labelLen-1] == '*')) {
+        labelLen--;
+    }
+    curr->minLength = curr->numEdges ? MAX_WORD_LENGTH : 0;
+    curr->maxLength = 0;
+    for (int i=0; i < curr->numEdges; i++) {
+        TrieNode_UpdateLengths( curr->edge[i] );
+        if (curr->edge[i]->minLength < curr->minLength) {
+            curr->minLength = curr->edge[i]->minLength;
+        }
+        if (curr->edge[i]->maxLength > curr->maxLength) {
+            curr->maxLength = curr->edge[i]->maxLength;
+        }
     }
+    curr->minLength += labelLen;
+    curr->maxLength += labelLen;
 }
 
+// Which letters a-z are used anywhere from this node down
+uint32_t TrieNode_UpdateLetters( TrieNode *curr )
+{
+    if (!curr->lettersDone) {
+        curr->letters = 0;
+        for (char *ch = curr->label; *ch; ch++) {
+            if ((*ch >= 'a') && (*ch <= 'z')) {
+                curr->letters |= 1 << (*ch - 'a');
+            }
+        }
+        for (int i=0; i < curr->numEdges; i++) {
+            curr->letters |= TrieNode_UpdateLetters( curr->edge[i] );
+        }
+        curr->lettersDone = true;
+    }
+    return curr->letters;
+}
 
+uint32_t NodeMaxWeight( TrieNode *curr ) { return curr->maxWeight; }
+uint32_t NodeLetters( TrieNode *curr ) { return curr->letters | (curr->minLength << 26); }
+uint32_t NodeLengths( TrieNode *curr ) { return curr->minLength | (curr->maxLength << 8); }
+uint32_t NodeWordCount( TrieNode *curr ) { return curr->wordCount; }
 
-int TrieNode_ReplaceSubtree( TrieNode *curr, TrieNode *replacement ) {
-    
-    int count = 0;
+// Write a u32 for each node into one of the optional sections that go after the nodes
+void PackNodeSection( TrieNode *curr, uint8_t *section, uint32_t (*nodeValue)( TrieNode *curr ) )
+{
+    // little-endian, like the rest of the file
+    uint32_t value = nodeValue( curr );
+    uint8_t *entry = section + (size_t)curr->packIndex * sizeof(uint32_t);
+    for (int i=0; i < 4; i++) {
+        entry[i] = (value >> (i*8)) & 0xFF;
+    }
     for (int i=0; i < curr->numEdges; i++) {
-        count += TrieNode_ReplaceSubtree( curr->edge[i], replacement );
-        
-        if ((curr->edge[i] != replacement) && (curr->edge[i]->hashcode == replacement->hashcode)) {
-            if (TrieNode_CompareSubtrees( curr->edge[i], replacement, 0)) {
-                
-                // TODO: Release memory                
-                curr->edge[i] = replacement;
-                count++;
-            }
+        PackNodeSection( curr->edge[i], section, nodeValue );
+    }
+}
+
+// ----------------------------------------------------------------------
+// Succinct nodes
+//
+// See WORDLIST_NODES_SUCCINCT in tk_wordlist.h. The nodes are numbered breadth
+// first and that number is the packIndex, so the optional sections are packed
+// the same way as for the other layouts.
+// ----------------------------------------------------------------------
+
+// A bit vector, written out as little endian u64s
+struct SuccinctBits {
+    std::vector<uint64_t> words;
+    uint64_t numBits;
+};
+
+void SuccinctBits_Push( SuccinctBits *bits, uint64_t value, int numBits )
+{
+    for (int i=0; i < numBits; i++, bits->numBits++) {
+        if ((bits->numBits % 64) == 0) {
+            bits->words.push_back( 0 );
+        }
+        if ((value >> i) & 1) {
+            bits->words.back() |= 1ULL << (bits->numBits % 64);
         }
     }
-    return count;
 }
 
-// ======================================================================
-// Word Tool main
-// ======================================================================
-int main( int argc, char *argv[] ) 
-{  
-    printf("...\n");
-        if (argc < 3) {
-        printf("Usage: wordtool <wordlist.txt> <wordfile.dat>\n");
-        return 1;
+// Appends a part to the section, 8 byte aligned, and returns its offset
+uint32_t AppendSuccinctPart( std::vector<uint8_t> &section, const uint8_t *data, size_t size )
+{
+    section.resize( (section.size() + 7) & ~(size_t)7 );
+    uint32_t offset = (uint32_t)section.size();
+    section.insert( section.end(), data, data + size );
+    return offset;
+}
+
+uint32_t AppendSuccinctWords( std::vector<uint8_t> &section, const std::vector<uint64_t> &words )
+{
+    std::vector<uint8_t> bytes( words.size() * 8 );
+    for (size_t i=0; i < bytes.size(); i++) {
+        bytes[i] = (words[i/8] >> ((i%8)*8)) & 0xFF;
     }
-    
-    const char *wordList = argv[1];
-    const char *wordDataFile = argv[2];
+    return AppendSuccinctPart( section, bytes.data(), bytes.size() );
+}
 
-    TrieNode *root = TrieNode_Alloc( "root" );
-    
-    int count = 0;
-    int rawsize = 0;
+uint32_t AppendSuccinctU32s( std::vector<uint8_t> &section, const std::vector<uint32_t> &values )
+{
+    std::vector<uint8_t> bytes( values.size() * 4 );
+    for (size_t i=0; i < bytes.size(); i++) {
+        bytes[i] = (values[i/4] >> ((i%4)*8)) & 0xFF;
+    }
+    return AppendSuccinctPart( section, bytes.data(), bytes.size() );
+}
 
-#if 0
-    // TrieNode_Insert( root, (char *)"team" );
-    // TrieNode_Insert( root, (char *)"test" );
-    // TrieNode_Insert( root, (char *)"teams" );
-    // TrieNode_Insert( root, (char *)"aardvark" );
-    // TrieNode_Insert( root, (char *)"aardwulf" );
-    TrieNode_Insert( root, (char *)"zoo" );
-    TrieNode_Insert( root, (char *)"zoos" );
-    TrieNode_Insert( root, (char *)"zookeeper" );
-    TrieNode_Insert( root, (char *)"zookeepers" );
+// Numbers the nodes breadth first and builds the node section. Returns the number of nodes.
+uint32_t PackSuccinct( TrieNode *root, std::vector<uint8_t> &section )
+{
+    std::vector<TrieNode*> order;
+    TrieNode_ClearPacked( root );
+    root->packIndex = 0;
+    root->packed = true;
+    order.push_back( root );
+    for (size_t q=0; q < order.size(); q++) {
+        TrieNode *node = order[q];
+        for (int i=0; i < node->numEdges; i++) {
+            if (!node->edge[i]->packed) {
+                node->edge[i]->packIndex = (uint32_t)order.size();
+                node->edge[i]->packed = true;
+                order.push_back( node->edge[i] );
+            }
+        }
+    }
+    uint32_t numNodes = (uint32_t)order.size();
+    int targetBits = 1;
+    while ((targetBits < 32) && ((numNodes - 1) >> targetBits)) {
+        targetBits++;
+    }
 
-    TrieNode_Insert( root, (char *)"cling" );
-    TrieNode_Insert( root, (char *)"clinger" );
-    TrieNode_Insert( root, (char *)"clings" );
-    
-    TrieNode_Insert( root, (char *)"claw" );
+    // Walk the edges in the same order again, the first edge to reach each node is the
+    // one that discovered it above.
+    SuccinctBits edgeBits = {};
+    SuccinctBits treeBits = {};
+    SuccinctBits targets = {};
+    SuccinctBits labelLengths = {};
+    std::vector<uint32_t> zeroSamples;
+    std::vector<uint32_t> treeRanks;
+    std::vector<uint32_t> labelStarts;
+    std::vector<uint8_t> labels;
+    uint32_t nextTree = 1;
+    for (uint32_t n=0; n < numNodes; n++) {
+        TrieNode *node = order[n];
+        for (int i=0; i < node->numEdges; i++) {
+            if ((treeBits.numBits % 512) == 0) {
+                treeRanks.push_back( nextTree - 1 );
+            }
+            SuccinctBits_Push( &edgeBits, 1, 1 );
+            uint32_t child = node->edge[i]->packIndex;
+            if (child == nextTree) {
+                SuccinctBits_Push( &treeBits, 1, 1 );
+                nextTree++;
+            } else {
+                SuccinctBits_Push( &treeBits, 0, 1 );
+                SuccinctBits_Push( &targets, child, targetBits );
+            }
+        }
+        if ((n % 64) == 0) {
+            zeroSamples.push_back( (uint32_t)edgeBits.numBits );
+        }
+        SuccinctBits_Push( &edgeBits, 0, 1 );
 
-    TrieNode_Insert( root, (char *)"zinger" );
-    TrieNode_Insert( root, (char *)"zings" );
-    TrieNode_Insert( root, (char *)"zing" );
+        // The root has no label, it gets one unused char so every length fits in 2 bits
+        if ((n % 32) == 0) {
+            labelStarts.push_back( (uint32_t)labels.size() );
+        }
+        int labelLen = n ? (int)strlen( node->label ) : 1;
+        SuccinctBits_Push( &labelLengths, labelLen - 1, 2 );
+        for (int i=0; i < labelLen; i++) {
+            labels.push_back( n ? node->label[i] : 0 );
+        }
+    }
+    if ((treeBits.numBits % 512) == 0) {
+        treeRanks.push_back( nextTree - 1 );
+    }
 
-    TrieNode_Insert( root, (char *)"troubadour" );
+    WordListSuccinctHeader header = {};
+    header.numEdges = (uint32_t)treeBits.numBits;
+    header.targetBits = targetBits;
+    section.assign( sizeof(header), 0 );
+    header.edgeBitsOffset = AppendSuccinctWords( section, edgeBits.words );
+    header.zeroSamplesOffset = AppendSuccinctU32s( section, zeroSamples );
+    header.treeBitsOffset = AppendSuccinctWords( section, treeBits.words );
+    header.treeRanksOffset = AppendSuccinctU32s( section, treeRanks );
+    header.targetsOffset = AppendSuccinctWords( section, targets.words );
+    header.labelLengthsOffset = AppendSuccinctWords( section, labelLengths.words );
+    header.labelStartsOffset = AppendSuccinctU32s( section, labelStarts );
+    header.labelsOffset = AppendSuccinctPart( section, labels.data(), labels.size() );
+    section.resize( (section.size() + 7) & ~(size_t)7 );
+    memcpy( section.data(), &header, sizeof(header) );
+    return numNodes;
+}
 
-    TrieNode_Insert( root, (char *)"bank" );
+// Update the hash and count
+uint64_t TrieNode_UpdateHash( TrieNode *curr )
+{
+    // Hash is kind of dumb, just djb-hash the label and then add all of the child nodes
+    uint64_t hash = 5381;
+    for (char *ch=curr->label; *ch; ch++) {
+        hash = ((hash << 5) + hash) + *ch;
+    }
+    hash = ((hash << 5) + hash) + curr->weight;
+    curr->nodeCount = 1; // count ourself
+    for (int i=0; i < curr->numEdges; i++) {
+        uint64_t edgeHash = TrieNode_UpdateHash( curr->edge[i] );
+        curr->nodeCount += curr->edge[i]->nodeCount;
+        //hash += edgeHash;
+        hash = ((hash << 5) + hash) + edgeHash;
+    }
+    curr->hashcode = hash;
+    return hash;
+}
+
+// Subtree dedup, by hash consing. Children are deduped before their parents, so two
+// subtrees are the same exactly when their labels and weights match and they point at
+// the same children. That's a shallow compare, and one pass over the tree gives the
+// fully minimized DAG. The table keeps the first node seen for each distinct subtree.
+struct NodeTable {
+    std::vector<TrieNode*> slots;   // open addressing, size is a power of 2
+    size_t count;
+};
+
+uint64_t TrieNode_ShallowHash( TrieNode *curr )
+{
+    uint64_t hash = 5381;
+    for (char *ch=curr->label; *ch; ch++) {
+        hash = ((hash << 5) + hash) + *ch;
+    }
+    hash = ((hash << 5) + hash) + curr->weight;
+    for (int i=0; i < curr->numEdges; i++) {
+        hash = ((hash << 5) + hash) + curr->edge[i]->nodeId;
+    }
+    // Mix the bits, the table uses the low ones
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+bool TrieNode_ShallowEqual( TrieNode *left, TrieNode *right )
+{
+    if ((left->hashcode != right->hashcode) || (left->numEdges != right->numEdges) ||
+        (left->weight != right->weight) || strcmp( left->label, right->label )) {
+        return false;
+    }
+    for (int i=0; i < left->numEdges; i++) {
+        if (left->edge[i] != right->edge[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void NodeTable_Grow( NodeTable *table )
+{
+    std::vector<TrieNode*> oldSlots;
+    oldSlots.swap( table->slots );
+    table->slots.resize( oldSlots.size() ? oldSlots.size() * 2 : 1024 );
+    size_t mask = table->slots.size() - 1;
+    for (size_t i=0; i < oldSlots.size(); i++) {
+        if (oldSlots[i]) {
+            size_t ndx = oldSlots[i]->hashcode & mask;
+            while (table->slots[ndx]) {
+                ndx = (ndx + 1) & mask;
+            }
+            table->slots[ndx] = oldSlots[i];
+        }
+    }
+}
+
+// Returns the node in the table that matches this one (hashcode must be set), or NULL
+TrieNode *NodeTable_Find( NodeTable *table, TrieNode *node )
+{
+    if (table->slots.empty()) {
+        return NULL;
+    }
+    size_t mask = table->slots.size() - 1;
+    size_t ndx = node->hashcode & mask;
+    while (table->slots[ndx]) {
+        if (TrieNode_ShallowEqual( table->slots[ndx], node )) {
+            return table->slots[ndx];
+        }
+        ndx = (ndx + 1) & mask;
+    }
+    return NULL;
+}
+
+void NodeTable_Add( NodeTable *table, TrieNode *node )
+{
+    if ((table->count + 1) * 2 > table->slots.size()) {
+        NodeTable_Grow( table );
+    }
+    size_t mask = table->slots.size() - 1;
+    size_t ndx = node->hashcode & mask;
+    while (table->slots[ndx]) {
+        ndx = (ndx + 1) & mask;
+    }
+    table->slots[ndx] = node;
+    table->count++;
+}
+
+// Returns the node already in the table that matches this one, or adds it
+TrieNode *NodeTable_Intern( NodeTable *table, TrieNode *node )
+{
+    TrieNode *match = NodeTable_Find( table, node );
+    if (match) {
+        return match;
+    }
+    NodeTable_Add( table, node );
+    return node;
+}
+
+// Returns the canonical node for this subtree, the duplicates stay in the arena until the
+// end. If the tree has already been deduped in parts (shards from -j) some nodes can be
+// reached more than once, the pass number means those are only gone through once.
+TrieNode *TrieNode_Dedupe( TrieNode *curr, NodeTable *table, uint8_t pass )
+{
+    if (curr->dedupePass == pass) {
+        // Children are already done, just find what this turned into
+        return NodeTable_Intern( table, curr );
+    }
+    curr->dedupePass = pass;
+    for (int i=0; i < curr->numEdges; i++) {
+        curr->edge[i] = TrieNode_Dedupe( curr->edge[i], table, pass );
+    }
+    curr->hashcode = TrieNode_ShallowHash( curr );
+    return NodeTable_Intern( table, curr );
+}
+
+// Streaming build for sorted input, after Daciuk et al. "Incremental Construction of
+// Minimal Acyclic Finite-State Automata". Only the last word is kept as plain letters.
+// When the next word branches off it, nothing below the branch can change any more, so
+// that part is turned into radix nodes (split into g_labelSize labels from the top, like
+// TrieNode_SplitLongNodes does) and merged with the node table right away. Nodes are
+// looked up before they're allocated, so memory is the finished DAG plus one word and
+// the result is the same as building the whole trie and deduping it.
+struct SortedBuilder {
+    NodeTable table;
+    char word[MAX_WORD_LENGTH+1];   // the last word, with the terminator
+    int wordLen;
+    uint32_t weight;
+
+    // Finished children hanging off each letter of the last word, from earlier words
+    std::vector<TrieNode*> children[MAX_WORD_LENGTH+1];
+};
+
+TrieNode *SortedBuilder_MakeNode( SortedBuilder *builder, const char *label, int labelLen,
+                                  TrieNode **edges, int numEdges, uint32_t weight )
+{
+    char labelBuff[MAX_WORD_LENGTH+1];
+    memcpy( labelBuff, label, labelLen );
+    labelBuff[labelLen] = '\0';
+
+    TrieNode probe = {};
+    probe.label = labelBuff;
+    probe.edge = edges;
+    probe.numEdges = (uint8_t)numEdges;
+    probe.weight = weight;
+    probe.hashcode = TrieNode_ShallowHash( &probe );
+    TrieNode *node = NodeTable_Find( &builder->table, &probe );
+    if (node) {
+        return node;
+    }
+
+    node = TrieNode_Alloc( label, labelLen );
+    for (int i=0; i < numEdges; i++) {
+        TrieNode_AddEdge( node, edges[i] );
+    }
+    node->weight = weight;
+    node->hashcode = probe.hashcode;
+    NodeTable_Add( &builder->table, node );
+    return node;
+}
+
+// Makes the nodes for a run of letters with only one way through it, ending at the children below
+TrieNode *SortedBuilder_MakeChain( SortedBuilder *builder, const char *chain, int chainLen,
+                                   std::vector<TrieNode*> &below, uint32_t weight )
+{
+    int start = ((chainLen - 1) / g_labelSize) * g_labelSize;
+    TrieNode *node = SortedBuilder_MakeNode( builder, chain + start, chainLen - start,
+                                             below.empty() ? NULL : &below[0], (int)below.size(), weight );
+    for (start -= g_labelSize; start >= 0; start -= g_labelSize) {
+        node = SortedBuilder_MakeNode( builder, chain + start, g_labelSize, &node, 1, 0 );
+    }
+    return node;
+}
+
+// Finishes everything in the last word after the first branchLen letters
+void SortedBuilder_Freeze( SortedBuilder *builder, int branchLen )
+{
+    std::vector<TrieNode*> below;
+    uint32_t weight = builder->weight;
+    int chainEnd = builder->wordLen;
+    for (int i = builder->wordLen - 1; i > branchLen; i--) {
+        // Earlier words branched off here, so the chain below is finished
+        if (!builder->children[i].empty()) {
+            TrieNode *node = SortedBuilder_MakeChain( builder, builder->word + i, chainEnd - i, below, weight );
+            below.swap( builder->children[i] );
+            builder->children[i].clear();
+            below.push_back( node );
+            chainEnd = i;
+            weight = 0;
+        }
+    }
+    TrieNode *node = SortedBuilder_MakeChain( builder, builder->word + branchLen, chainEnd - branchLen, below, weight );
+    builder->children[branchLen].push_back( node );
+}
+
+// Returns false if the words aren't in order
+bool SortedBuilder_Add( SortedBuilder *builder, const char *word, uint32_t weight )
+{
+    char next[MAX_WORD_LENGTH+1];
+    snprintf( next, sizeof(next), "%s*", word );
+    int nextLen = (int)strlen( next );
+
+    int branchLen = 0;
+    while ((branchLen < builder->wordLen) && (next[branchLen] == builder->word[branchLen])) {
+        branchLen++;
+    }
+    if (branchLen == builder->wordLen) {
+        if (builder->wordLen) {
+            // Same word again, keep the bigger weight
+            if (weight > builder->weight) {
+                builder->weight = weight;
+            }
+            return true;
+        }
+    } else if ((uint8_t)next[branchLen] < (uint8_t)builder->word[branchLen]) {
+        return false;
+    } else {
+        SortedBuilder_Freeze( builder, branchLen );
+    }
+    memcpy( builder->word, next, nextLen + 1 );
+    builder->wordLen = nextLen;
+    builder->weight = weight;
+    return true;
+}
+
+TrieNode *SortedBuilder_Finish( SortedBuilder *builder )
+{
+    if (builder->wordLen) {
+        SortedBuilder_Freeze( builder, 0 );
+    }
+    TrieNode *root = TrieNode_Alloc( "", 0 );
+    for (size_t i=0; i < builder->children[0].size(); i++) {
+        TrieNode_AddEdge( root, builder->children[0][i] );
+    }
+    return root;
+}
+
+// ----------------------------------------------------------------------
+// Reading word lists
+//
+// The word lists are mapped and split into lines with memchr (which libc does
+// with SIMD), and each line is cleaned up in one pass as it's copied out.
+// ----------------------------------------------------------------------
+struct MappedFile {
+    const char *data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+};
+
+bool MappedFile_Open( MappedFile *file, const char *filename )
+{
+    memset( file, 0, sizeof(MappedFile) );
+#ifdef _WIN32
+    HANDLE handle = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                 FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx( handle, &size )) {
+        CloseHandle( handle );
+        return false;
+    }
+    file->size = (size_t)size.QuadPart;
+    if (file->size) {
+        file->mapping = CreateFileMappingA( handle, NULL, PAGE_READONLY, 0, 0, NULL );
+        if (file->mapping) {
+            file->data = (const char*)MapViewOfFile( file->mapping, FILE_MAP_READ, 0, 0, 0 );
+        }
+    }
+    CloseHandle( handle );
+    return (file->size == 0) || (file->data != NULL);
+#else
+    int fd = open( filename, O_RDONLY );
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat( fd, &info ) != 0) {
+        close( fd );
+        return false;
+    }
+    file->size = (size_t)info.st_size;
+    if (file->size) {
+        void *data = mmap( NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if (data != MAP_FAILED) {
+            madvise( data, file->size, MADV_SEQUENTIAL );
+            file->data = (const char*)data;
+        }
+    }
+    close( fd );
+    return (file->size == 0) || (file->data != NULL);
+#endif
+}
+
+void MappedFile_Close( MappedFile *file )
+{
+#ifdef _WIN32
+    if (file->data) {
+        UnmapViewOfFile( file->data );
+    }
+    if (file->mapping) {
+        CloseHandle( file->mapping );
+    }
+#else
+    if (file->data) {
+        munmap( (void*)file->data, file->size );
+    }
+#endif
+    memset( file, 0, sizeof(MappedFile) );
+}
+
+struct WordOptions {
+    bool foldCase;      // make everything lower case
+    bool quAsQ;         // "qu" becomes "q", for games with a Qu tile
+};
+
+struct WordReader {
+    const char *filename;
+    MappedFile file;
+    const char *pos;
+    WordOptions options;
+    size_t numLines;
+    size_t numSkipped;  // too long, or had a character that can't be packed
+    bool hasWeights;
+};
+
+bool WordReader_Open( WordReader *reader, const char *filename, const WordOptions &options )
+{
+    memset( reader, 0, sizeof(WordReader) );
+    if (!MappedFile_Open( &reader->file, filename )) {
+        return false;
+    }
+    reader->filename = filename;
+    reader->pos = reader->file.data;
+    reader->options = options;
+    return true;
+}
+
+// Gets the next word, with an optional weight after it, skipping blank lines and words
+// that are too long or have a '*', '%' or whitespace in them, like WordList_OverlayAdd.
+// word needs room for MAX_WORD_LENGTH. Returns false at the end.
+bool WordReader_Next( WordReader *reader, char *word, int *wordLen, uint32_t *weight )
+{
+    const char *end = reader->file.data + reader->file.size;
+    while (reader->pos < end) {
+        const char *line = reader->pos;
+        const char *lineEnd = (const char*)memchr( line, '\n', end - line );
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        reader->pos = (lineEnd < end) ? lineEnd + 1 : end;
+        reader->numLines++;
+
+        int len = 0;
+        bool tooLong = false;
+        const char *ch = line;
+        for (; (ch < lineEnd) && (*ch != ' ') && (*ch != '\t'); ch++) {
+            char c = *ch;
+            if (reader->options.foldCase && (c >= 'A') && (c <= 'Z')) {
+                c = c - 'A' + 'a';
+            }
+            if (reader->options.quAsQ && ((c == 'u') || (c == 'U')) && (len > 0) &&
+                ((word[len-1] == 'q') || (word[len-1] == 'Q'))) {
+                continue;
+            }
+            if (len < MAX_WORD_LENGTH) {
+                word[len++] = c;
+            } else {
+                tooLong = true;
+            }
+        }
+
+        // An optional weight column after the word, just trailing whitespace doesn't count.
+        // Weights too big for a u32 are clamped.
+        uint64_t bigWeight = 0;
+        bool hasWeight = false;
+        while ((ch < lineEnd) && ((*ch == ' ') || (*ch == '\t'))) {
+            ch++;
+        }
+        while ((ch < lineEnd) && (*ch >= '0') && (*ch <= '9')) {
+            bigWeight = std::min<uint64_t>( bigWeight * 10 + (*ch - '0'), (uint64_t)UINT32_MAX + 1 );
+            hasWeight = true;
+            ch++;
+        }
+        if (bigWeight > UINT32_MAX) {
+            printf("Weight for '%.*s' in %s line %zu is too big, using %u\n",
+                   (int)(lineEnd - line), line, reader->filename, reader->numLines, UINT32_MAX );
+            bigWeight = UINT32_MAX;
+        }
+        *weight = (uint32_t)bigWeight;
+        reader->hasWeights = reader->hasWeights || hasWeight;
+
+        // Strip CR, also strip % which the word list uses to indicate plurals
+        while ((len > 0) && ((word[len-1] == '\r') || (word[len-1] == '%'))) {
+            len--;
+        }
+        if (len == 0) {
+            continue;
+        }
+        // Room for the '*' terminator and the '\0', same as the runtime lookups allow
+        if (tooLong || (len + 2 > MAX_WORD_LENGTH)) {
+            if (reader->numSkipped++ < 5) {
+                printf("Skipping word '%.*s' in %s line %zu, longer than %d letters\n",
+                       (int)(lineEnd - line), line, reader->filename, reader->numLines, MAX_WORD_LENGTH-2 );
+            }
+            continue;
+        }
+        // '*' is the terminator, a word with one in it would end early in the lookups
+        // but not in the searches
+        bool badChar = false;
+        for (int i=0; i < len; i++) {
+            if (((uint8_t)word[i] <= ' ') || (word[i] == '*') || (word[i] == '%')) {
+                badChar = true;
+            }
+        }
+        if (badChar) {
+            if (reader->numSkipped++ < 5) {
+                printf("Skipping word '%.*s' in %s line %zu, it has a '*', '%%' or whitespace in it\n",
+                       (int)(lineEnd - line), line, reader->filename, reader->numLines );
+            }
+            continue;
+        }
+        word[len] = '\0';
+        *wordLen = len;
+        return true;
+    }
+    return false;
+}
+
+void WordReader_Close( WordReader *reader )
+{
+    MappedFile_Close( &reader->file );
+}
+
+// Words are compared as if they had the '*' terminator on the end, that's the order
+// the edges end up in and the order --sorted needs
+int WordCompare( const char *a, int lenA, const char *b, int lenB )
+{
+    int len = (lenA < lenB) ? lenA : lenB;
+    int result = memcmp( a, b, len );
+    if (result || (lenA == lenB)) {
+        return result;
+    }
+    uint8_t nextA = (len < lenA) ? (uint8_t)a[len] : '*';
+    uint8_t nextB = (len < lenB) ? (uint8_t)b[len] : '*';
+    return (int)nextA - (int)nextB;
+}
+
+struct WordEntry {
+    uint64_t sortKey;   // first 8 bytes of the word and terminator, big endian, so most compares are one int
+    const char *word;   // in the words arena
+    uint32_t weight;
+    uint8_t len;
+};
+
+uint64_t WordSortKey( const char *word, int len )
+{
+    uint64_t key = 0;
+    for (int i=0; i < 8; i++) {
+        uint8_t ch = (i < len) ? (uint8_t)word[i] : ((i == len) ? '*' : 0);
+        key = (key << 8) | ch;
+    }
+    return key;
+}
+
+bool WordEntryLess( const WordEntry &a, const WordEntry &b )
+{
+    if (a.sortKey != b.sortKey) {
+        return a.sortKey < b.sortKey;
+    }
+    return WordCompare( a.word, a.len, b.word, b.len ) < 0;
+}
+
+// Reads all of the words, sorted with the repeats taken out. Repeated words keep
+// the biggest weight.
+void ReadAllWords( std::vector<WordReader> &readers, Arena *wordArena, std::vector<WordEntry> &words )
+{
+    char word[MAX_WORD_LENGTH];
+    int len;
+    uint32_t weight;
+    for (size_t r=0; r < readers.size(); r++) {
+        while (WordReader_Next( &readers[r], word, &len, &weight )) {
+            WordEntry entry;
+            char *text = (char*)Arena_Alloc( wordArena, len + 1 );
+            memcpy( text, word, len + 1 );
+            entry.sortKey = WordSortKey( text, len );
+            entry.word = text;
+            entry.weight = weight;
+            entry.len = (uint8_t)len;
+            words.push_back( entry );
+        }
+    }
+    std::sort( words.begin(), words.end(), WordEntryLess );
+
+    size_t numUnique = 0;
+    for (size_t i=0; i < words.size(); i++) {
+        if ((numUnique > 0) && (words[numUnique-1].len == words[i].len) &&
+            (!memcmp( words[numUnique-1].word, words[i].word, words[i].len ))) {
+            if (words[i].weight > words[numUnique-1].weight) {
+                words[numUnique-1].weight = words[i].weight;
+            }
+        } else {
+            words[numUnique++] = words[i];
+        }
+    }
+    words.resize( numUnique );
+}
+
+// Parallel build for -j. The words are split into shards by their first letter, which
+// is also how they split under the root, so each shard's trie can be built, split and
+// deduped on its own thread. Then the shards' top nodes go under one root and get
+// deduped again, to share the suffixes that are in more than one shard.
+struct BuildShard {
+    std::vector<const WordEntry*> words;
+    Arena arena;
+    TrieNode *root;
+    size_t numUnique;
+};
+
+void BuildShard_Run( BuildShard *shard )
+{
+    t_arena = &shard->arena;
+    shard->root = TrieNode_Alloc( "", 0 );
+    char word[MAX_WORD_LENGTH];
+    for (size_t i=0; i < shard->words.size(); i++) {
+        memcpy( word, shard->words[i]->word, shard->words[i]->len + 1 );
+        TrieNode *leaf = TrieNode_Insert( shard->root, word );
+        leaf->weight = shard->words[i]->weight;
+    }
+    TrieNode_SplitLongNodes( shard->root, g_labelSize );
+    TrieNode_NormalizeEdges( shard->root );
+
+    NodeTable nodeTable = {};
+    shard->root = TrieNode_Dedupe( shard->root, &nodeTable, 1 );
+    shard->numUnique = nodeTable.count;
+}
+
+// Returns the merged root
+TrieNode *BuildShards( const std::vector<WordEntry> &words, int numThreads, std::vector<BuildShard*> &shards )
+{
+    // Give each thread a run of first letters with about the same number of words
+    size_t letterCount[256] = {};
+    for (size_t i=0; i < words.size(); i++) {
+        letterCount[ (uint8_t)words[i].word[0] ]++;
+    }
+    int letterShard[256];
+    size_t wordsSoFar = 0;
+    for (int ch=0; ch < 256; ch++) {
+        letterShard[ch] = (int)((wordsSoFar * numThreads) / (words.size() ? words.size() : 1));
+        wordsSoFar += letterCount[ch];
+    }
+    for (int i=0; i < numThreads; i++) {
+        shards.push_back( new BuildShard() );
+    }
+    for (size_t i=0; i < words.size(); i++) {
+        shards[ letterShard[ (uint8_t)words[i].word[0] ] ]->words.push_back( &words[i] );
+    }
+
+    std::vector<std::thread> threads;
+    for (int i=0; i < numThreads; i++) {
+        threads.push_back( std::thread( BuildShard_Run, shards[i] ) );
+    }
+    for (int i=0; i < numThreads; i++) {
+        threads[i].join();
+    }
+
+    TrieNode *root = TrieNode_Alloc( "", 0 );
+    for (int i=0; i < numThreads; i++) {
+        printf("Shard %d: %zu words, %zu unique nodes.\n", i, shards[i]->words.size(), shards[i]->numUnique );
+        for (int e=0; e < shards[i]->root->numEdges; e++) {
+            TrieNode_AddEdge( root, shards[i]->root->edge[e] );
+        }
+    }
+    if (root->numEdges > 0) {
+        qsort( root->edge, root->numEdges, sizeof(TrieNode*), nodeLabelCmp );
+    }
+    return root;
+}
+
+// ======================================================================
+// Tuning
+//
+// The best label size and edge limit depend on the word list. Short labels
+// make more nodes but smaller ones, and a low edge limit makes small nodes but
+// branchy ones spill into the nodes after them. --tune packs the list every
+// way and times lookups on each, then packs it the best way.
+// ======================================================================
+enum TuneGoal {
+    Tune_Off,
+    Tune_Speed,     // fastest lookups
+    Tune_Size,      // smallest file
+};
+
+// Packs with the smallest edge index, of at least minEdgeIndexSize bytes, that can
+// reach every node. Returns the number of pack nodes, or 0 if no edge index that
+// fits in an aligned node can reach them all.
+uint32_t PackSmallestFormat( TrieNode *root, int minEdgeIndexSize, int nodeAlign, bool childLabels,
+                             PackLayoutType layout, WordListFormat *format )
+{
+    for (int edgeIndexSize = minEdgeIndexSize; edgeIndexSize <= 4; edgeIndexSize++) {
+        if (nodeAlign && (edgeIndexSize == 3)) {
+            // Can't align these
+            continue;
+        }
+        *format = MakePackFormat( edgeIndexSize, nodeAlign, childLabels );
+        if (format->edgeLimit < 1) {
+            // No room for an edge after the label (4 byte indices in 8 byte nodes), every
+            // edge would spill into the following nodes, which is worse than packed
+            continue;
+        }
+        uint32_t numPackNodes = PackLayout( root, *format, layout );
+        uint64_t maxIndex = (1ULL << (edgeIndexSize*8)) - 1;
+        if (numPackNodes - 1 <= maxIndex) {
+            return numPackNodes;
+        }
+    }
+    return 0;
+}
+
+WordListHeader MakePackHeader( const WordListFormat &format, uint32_t numPackNodes, uint32_t numWords, int nodeAlign )
+{
+    WordListHeader header = {};
+    memcpy( header.magic, WORDLIST_MAGIC, 4 );
+    header.version = WORDLIST_VERSION;
+    header.headerSize = sizeof(WordListHeader);
+    header.numNodes = numPackNodes;
+    header.numWords = numWords;
+    header.edgeIndexSize = format.edgeIndexSize;
+    header.edgeLimit = format.edgeLimit;
+    header.labelSize = format.labelSize;
+    header.nodeSize = format.nodeSize;
+    header.nodesOffset = sizeof(WordListHeader);
+    header.nodeLayout = format.succinct ? WORDLIST_NODES_SUCCINCT :
+                        nodeAlign ? WORDLIST_NODES_ALIGNED : WORDLIST_NODES_PACKED;
+    header.edgesOffset = format.edgesOffset;
+    header.childLabels = format.childLabels;
+    return header;
+}
+
+struct TuneResult {
+    WordListFormat format;
+    int nodeAlign;
+    uint32_t numPackNodes;
+    std::vector<uint8_t> fileData;  // header and nodes, without the optional sections
+    WordList wordlist;
+    double bestSeconds;
+};
+
+// Words to time lookups with, up to 100k words from the list and a changed copy of
+// each that's usually not in it. Shuffled so the lookups don't walk the trie in order.
+void MakeTuneProbes( const std::vector<WordEntry> &words, std::vector<char> &probeChars,
+                     std::vector<const char*> &probes )
+{
+    size_t step = (words.size() / 100000) + 1;
+    std::vector<size_t> offsets;
+    for (size_t i=0; i < words.size(); i += step) {
+        for (int miss=0; miss < 2; miss++) {
+            offsets.push_back( probeChars.size() );
+            probeChars.insert( probeChars.end(), words[i].word, words[i].word + words[i].len + 1 );
+            if (miss) {
+                char &last = probeChars[ probeChars.size() - 2 ];
+                last = (last == 'z') ? 'a' : last + 1;
+            }
+        }
+    }
+    uint32_t seed = 12345;
+    for (size_t i = offsets.size(); i > 1; i--) {
+        seed = seed * 1664525 + 1013904223;
+        std::swap( offsets[i-1], offsets[ (seed >> 8) % i ] );
+    }
+    for (size_t i=0; i < offsets.size(); i++) {
+        probes.push_back( &probeChars[ offsets[i] ] );
+    }
+}
+
+// Packs the trie in this format and opens it, ready to time. Returns false if
+// the list can't be packed this way.
+bool TunePack( TrieNode *root, uint32_t numWords, int minEdgeIndexSize, int nodeAlign, bool childLabels,
+               PackLayoutType layout, TuneResult *result )
+{
+    result->nodeAlign = nodeAlign;
+    result->numPackNodes = PackSmallestFormat( root, minEdgeIndexSize, nodeAlign, childLabels, layout, &result->format );
+    if (!result->numPackNodes) {
+        return false;
+    }
+    size_t fileSize = sizeof(WordListHeader) + (size_t)result->numPackNodes * result->format.nodeSize;
+
+    result->fileData.resize( fileSize );
+    uint8_t *packData = &result->fileData[sizeof(WordListHeader)];
+    PackWordList( root, packData, result->format );
+    WordListHeader header = MakePackHeader( result->format, result->numPackNodes, numWords, nodeAlign );
+    header.fileSize = (uint32_t)fileSize;
+    header.dataChecksum = WordList_Checksum( packData, fileSize - sizeof(WordListHeader) );
+    memcpy( &result->fileData[0], &header, sizeof(WordListHeader) );
+
+    if (!WordList_OpenMemory( &result->wordlist, &result->fileData[0], fileSize )) {
+        printf("ERROR Packed data is broken: %s\n", result->wordlist.error );
+        exit(1);
+    }
+    return true;
+}
+
+// Formats timed within this many percent of the fastest count as just as fast. Most
+// of them come out within a few percent of each other, and the timings move around by
+// more than that from run to run on a busy machine, so picking the very fastest would
+// pick a different one every time.
+#define TUNE_TIED_PERCENT (10)
+
+// Tries label sizes from minLabelSize to 4 with a range of edge limits and the aligned
+// layouts, prints how each did and sets g_labelSize, g_edgeLimit and nodeAlign to the best.
+// For speed that's the smallest of the ones tied for fastest, for size the smallest, and
+// then the first one tried, so the same list gets the same format every time.
+void TuneFormat( const std::vector<WordEntry> &words, TuneGoal goal, int minLabelSize,
+                 int minEdgeIndexSize, bool childLabels, PackLayoutType layout, int *nodeAlign )
+{
+    static const int edgeLimits[] = { 1, 2, 3, 4, 6, 8 };
+    static const int nodeAligns[] = { 8, 16 };
+    if (words.empty()) {
+        return;
+    }
+
+    std::vector<char> probeChars;
+    std::vector<const char*> probes;
+    MakeTuneProbes( words, probeChars, probes );
+
+    // Each label size needs its own trie, in its own arena so it can be thrown away.
+    // The free edge lists are in the arena too, so they go with it.
+    Arena *prevArena = t_arena;
+    TrieNode **prevFreeEdgeLists[MAX_EDGE_LIST_SIZES];
+    memcpy( prevFreeEdgeLists, t_freeEdgeLists, sizeof(t_freeEdgeLists) );
+    int prevNodeCount = g_nodeCount.load();
+    std::vector<TuneResult*> results;
+    for (int labelSize = minLabelSize; labelSize <= 4; labelSize++) {
+        Arena tuneArena = {};
+        t_arena = &tuneArena;
+        memset( t_freeEdgeLists, 0, sizeof(t_freeEdgeLists) );
+        g_labelSize = labelSize;
+        TrieNode *root = TrieNode_Alloc( "", 0 );
+        char word[MAX_WORD_LENGTH];
+        for (size_t i=0; i < words.size(); i++) {
+            memcpy( word, words[i].word, words[i].len + 1 );
+            TrieNode_Insert( root, word );
+        }
+        TrieNode_SplitLongNodes( root, labelSize );
+        TrieNode_NormalizeEdges( root );
+        NodeTable nodeTable = {};
+        root = TrieNode_Dedupe( root, &nodeTable, 1 );
+
+        int numLimits = sizeof(edgeLimits) / sizeof(edgeLimits[0]);
+        int numAligns = sizeof(nodeAligns) / sizeof(nodeAligns[0]);
+        for (int i=0; i < numLimits + numAligns; i++) {
+            int align = (i < numLimits) ? 0 : nodeAligns[i - numLimits];
+            g_edgeLimit = (i < numLimits) ? edgeLimits[i] : EDGE_LIMIT;
+            results.push_back( new TuneResult() );
+            if (!TunePack( root, (uint32_t)words.size(), minEdgeIndexSize, align, childLabels, layout, results.back() )) {
+                delete results.back();
+                results.pop_back();
+            }
+        }
+        Arena_Release( &tuneArena );
+    }
+    t_arena = prevArena;
+    memcpy( t_freeEdgeLists, prevFreeEdgeLists, sizeof(t_freeEdgeLists) );
+    g_nodeCount = prevNodeCount;
+
+    // Time them in turns and keep the best of each, so a slow patch on the machine
+    // doesn't count against one of them more than the others
+    for (int round=0; round < 7; round++) {
+        for (size_t r=0; r < results.size(); r++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            size_t found = 0;
+            for (size_t i=0; i < probes.size(); i++) {
+                found += WordList_Contains( &results[r]->wordlist, probes[i] );
+            }
+            double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+            if (found < probes.size() / 2) {
+                printf("ERROR Packed data is broken, only found %zu of %zu words\n", found, probes.size() / 2 );
+                exit(1);
+            }
+            if ((round == 0) || (seconds < results[r]->bestSeconds)) {
+                results[r]->bestSeconds = seconds;
+            }
+        }
+    }
+
+    double fastestSeconds = results[0]->bestSeconds;
+    for (size_t i=1; i < results.size(); i++) {
+        fastestSeconds = std::min( fastestSeconds, results[i]->bestSeconds );
+    }
+    double tiedSeconds = fastestSeconds * (100 + TUNE_TIED_PERCENT) / 100;
+
+    size_t best = results.size();
+    for (size_t i=0; i < results.size(); i++) {
+        if ((goal == Tune_Speed) && (results[i]->bestSeconds > tiedSeconds)) {
+            continue;
+        }
+        if ((best == results.size()) || (results[i]->fileData.size() < results[best]->fileData.size())) {
+            best = i;
+        }
+    }
+
+    printf("Tuning with %zu lookups, half of them misses, within %d%% of the fastest counts as tied:\n",
+           probes.size(), TUNE_TIED_PERCENT );
+    printf("  label  edges  layout    index  node    pack nodes      bytes  M lookups/s\n");
+    for (size_t i=0; i < results.size(); i++) {
+        const TuneResult &r = *results[i];
+        char layoutName[16];
+        snprintf( layoutName, sizeof(layoutName), r.nodeAlign ? "align=%d" : "packed", r.nodeAlign );
+        printf("  %5u  %5u  %-8s  %5u  %4u  %12u  %9zu  %11.2f%s\n", r.format.labelSize, r.format.edgeLimit,
+               layoutName, r.format.edgeIndexSize, r.format.nodeSize, r.numPackNodes, r.fileData.size(),
+               probes.size() / (r.bestSeconds * 1e6), (i == best) ? " <-- using this" : "" );
+    }
+    g_labelSize = results[best]->format.labelSize;
+    g_edgeLimit = results[best]->nodeAlign ? EDGE_LIMIT : results[best]->format.edgeLimit;
+    *nodeAlign = results[best]->nodeAlign;
+    printf("Tuned for %s: --label-size=%d %s%d\n", (goal == Tune_Size) ? "size" : "speed", g_labelSize,
+           *nodeAlign ? "--align=" : "--edge-limit=", *nodeAlign ? *nodeAlign : g_edgeLimit );
+    for (size_t i=0; i < results.size(); i++) {
+        WordList_Close( &results[i]->wordlist );
+        delete results[i];
+    }
+}
+
+// ======================================================================
+// Output
+//
+// Besides the data file, the packed list can be written out as source code and
+// built into a program. Then it's in the program's read only data and there's
+// nothing to load at startup.
+// ======================================================================
+enum EmitType {
+    Emit_Data,      // the data file
+    Emit_C,         // C source with the data in a const array
+    Emit_Constexpr, // a C++17 header with the data in a constexpr array
+    Emit_Incbin,    // the data file, and an assembler file that .incbin's it
+
+    Emit_COUNT
+};
+
+const char *g_emitNames[Emit_COUNT] = { "dat", "c", "constexpr", "incbin" };
+
+// Name for the embedded data, the output file name without the directory or extension
+std::string EmbedName( const char *path )
+{
+    const char *base = path;
+    for (const char *ch = path; *ch; ch++) {
+        if ((*ch == '/') || (*ch == '\\')) {
+            base = ch + 1;
+        }
+    }
+    std::string name;
+    for (const char *ch = base; *ch && (*ch != '.'); ch++) {
+        bool ok = ((*ch >= 'a') && (*ch <= 'z')) || ((*ch >= 'A') && (*ch <= 'Z')) ||
+                  ((*ch >= '0') && (*ch <= '9'));
+        name += ok ? *ch : '_';
+    }
+    if (name.empty() || ((name[0] >= '0') && (name[0] <= '9'))) {
+        name = "wordlist_" + name;
+    }
+    return name;
+}
+
+void WriteByteArray( FILE *fp, const uint8_t *data, size_t size )
+{
+    for (size_t i=0; i < size; i += 24) {
+        fprintf( fp, "   " );
+        for (size_t j=i; (j < i + 24) && (j < size); j++) {
+            fprintf( fp, " %u,", data[j] );
+        }
+        fprintf( fp, "\n" );
+    }
+}
+
+bool WriteDataFile( const char *filename, const uint8_t *data, size_t size )
+{
+    FILE *fp = fopen( filename, "wb" );
+    if (!fp) {
+        return false;
+    }
+    size_t result = fwrite( data, size, 1, fp );
+    return (fclose( fp ) == 0) && (result == 1);
+}
+
+bool WriteCSource( const char *filename, const std::string &name, const uint8_t *data, size_t size )
+{
+    FILE *fp = fopen( filename, "w" );
+    if (!fp) {
+        return false;
+    }
+    fprintf( fp,
+        "// Packed word list, generated by wordtool --emit=c. Declare it with\n"
+        "// WORDLIST_EMBEDDED( %s ) and open it with\n"
+        "// WordList_OpenMemory( &wordlist, %s, %s_size ).\n"
+        "\n"
+        "#include <stddef.h>\n"
+        "\n"
+        "#ifdef __cplusplus\n"
+        "#define WORDLIST_EMBEDDED_EXTERN extern \"C\"\n"
+        "#else\n"
+        "#define WORDLIST_EMBEDDED_EXTERN\n"
+        "#endif\n"
+        "\n"
+        "#if defined(_MSC_VER)\n"
+        "#define WORDLIST_EMBEDDED_ALIGN __declspec(align(16))\n"
+        "#else\n"
+        "#define WORDLIST_EMBEDDED_ALIGN __attribute__((aligned(16)))\n"
+        "#endif\n"
+        "\n"
+        "WORDLIST_EMBEDDED_EXTERN WORDLIST_EMBEDDED_ALIGN const unsigned char %s[%zu] = {\n",
+        name.c_str(), name.c_str(), name.c_str(), name.c_str(), size );
+    WriteByteArray( fp, data, size );
+    fprintf( fp, "};\n\nWORDLIST_EMBEDDED_EXTERN const size_t %s_size = %zu;\n", name.c_str(), size );
+    return (fclose( fp ) == 0);
+}
+
+// The tk::WordList type that reads this format
+std::string WordListTypeName( const WordListFormat &format, int nodeAlign )
+{
+    const char *indexType = (format.edgeIndexSize == 2) ? "u16" : (format.edgeIndexSize == 3) ? "tk::Index24" : "u32";
+    char typeName[100];
+    snprintf( typeName, sizeof(typeName), "tk::WordList<%s, %u, tk::Layout::%s>", indexType, format.edgeLimit,
+              (nodeAlign == 16) ? "Aligned16" : (nodeAlign == 8) ? "Aligned8" : "Packed" );
+    return typeName;
+}
+
+bool WriteConstexprHeader( const char *filename, const std::string &name, const std::string &typeName,
+                           const uint8_t *data, size_t size )
+{
+    FILE *fp = fopen( filename, "w" );
+    if (!fp) {
+        return false;
+    }
+    std::string guard = name;
+    for (size_t i=0; i < guard.size(); i++) {
+        guard[i] = toupper( (unsigned char)guard[i] );
+    }
+    fprintf( fp,
+        "// Packed word list, generated by wordtool --emit=constexpr. %s_list can be\n"
+        "// used at compile time, e.g. static_assert( %s_list.Contains( \"word\" ) );\n"
+        "\n"
+        "#ifndef %s_WORDLIST_HPP\n"
+        "#define %s_WORDLIST_HPP\n"
+        "\n"
+        "#include \"tk_wordlist.hpp\"\n"
+        "\n"
+        "alignas(16) inline constexpr unsigned char %s[%zu] = {\n",
+        name.c_str(), name.c_str(), guard.c_str(), guard.c_str(), name.c_str(), size );
+    WriteByteArray( fp, data, size );
+    fprintf( fp,
+        "};\n"
+        "\n"
+        "inline constexpr %s %s_list = %s::FromBytes( %s, sizeof(%s) );\n"
+        "\n"
+        "#endif\n",
+        typeName.c_str(), name.c_str(), typeName.c_str(), name.c_str(), name.c_str() );
+    return (fclose( fp ) == 0);
+}
+
+// Assembler that pulls in the data file with .incbin, this needs the GNU or clang
+// assembler. Run it through the preprocessor (a .S file) for the platform differences.
+bool WriteIncbinSource( const char *filename, const std::string &name, const char *dataFile )
+{
+#ifdef _WIN32
+    char fullPath[4096];
+    if (!_fullpath( fullPath, dataFile, sizeof(fullPath) )) {
+        return false;
+    }
+    for (char *ch = fullPath; *ch; ch++) {
+        if (*ch == '\\') {
+            *ch = '/';
+        }
+    }
+#else
+    char fullPath[PATH_MAX];
+    if (!realpath( dataFile, fullPath )) {
+        return false;
+    }
+#endif
+    FILE *fp = fopen( filename, "w" );
+    if (!fp) {
+        return false;
+    }
+    const char *n = name.c_str();
+    fprintf( fp,
+        "// Packed word list, generated by wordtool --emit=incbin. Declare it with\n"
+        "// WORDLIST_EMBEDDED( %s ) and open it with\n"
+        "// WordList_OpenMemory( &wordlist, %s, %s_size ).\n"
+        "\n"
+        "#if defined(__APPLE__) || (defined(_WIN32) && !defined(_WIN64))\n"
+        "#define WORDLIST_SYMBOL(x) _##x\n"
+        "#else\n"
+        "#define WORDLIST_SYMBOL(x) x\n"
+        "#endif\n"
+        "\n"
+        "#if defined(__APPLE__)\n"
+        "    .const_data\n"
+        "#elif defined(_WIN32)\n"
+        "    .section .rdata,\"dr\"\n"
+        "#else\n"
+        "    .section .rodata\n"
+        "#endif\n"
+        "\n"
+        "    .globl WORDLIST_SYMBOL(%s)\n"
+        "    .balign 16\n"
+        "WORDLIST_SYMBOL(%s):\n"
+        "    .incbin \"%s\"\n"
+        "WORDLIST_SYMBOL(%s_end):\n"
+        "\n"
+        "    .globl WORDLIST_SYMBOL(%s_size)\n"
+        "    .balign 8\n"
+        "WORDLIST_SYMBOL(%s_size):\n"
+        "#if defined(__LP64__) || defined(_WIN64)\n"
+        "    .quad WORDLIST_SYMBOL(%s_end) - WORDLIST_SYMBOL(%s)\n"
+        "#else\n"
+        "    .long WORDLIST_SYMBOL(%s_end) - WORDLIST_SYMBOL(%s)\n"
+        "#endif\n"
+        "\n"
+        "#if defined(__linux__) && defined(__ELF__)\n"
+        "    .section .note.GNU-stack,\"\",%%progbits\n"
+        "#endif\n",
+        n, n, n, n, n, fullPath, n, n, n, n, n, n, n );
+    return (fclose( fp ) == 0);
+}
+
+// ======================================================================
+// Word Tool main
+// ======================================================================
+int main( int argc, char *argv[] ) 
+{  
+    printf("...\n");
+
+    // Options can go anywhere, everything else is a file name
+    std::vector<const char*> files;
+    WordOptions wordOptions = {};
+    int minEdgeIndexSize = 2;
+    PackLayoutType layout = PackLayout_DFS;
+    int nodeAlign = 0;
+    bool childLabels = false;
+    bool layoutSet = false;
+    bool succinct = false;
+    bool wordIndex = false;
+    bool summaries = false;
+    int filterBits = 0;
+    bool sortedInput = false;
+    int numThreads = 1;
+    EmitType emit = Emit_Data;
+    TuneGoal tune = Tune_Off;
+    bool formatOptions = false;
+    for (int i=1; i < argc; i++) {
+        if (!strncmp( argv[i], "--edge-index-size=", 18 )) {
+            minEdgeIndexSize = atoi( argv[i] + 18 );
+            if ((minEdgeIndexSize < 2) || (minEdgeIndexSize > 4)) {
+                printf("ERROR: edge index size must be 2, 3 or 4\n");
+                return 1;
+            }
+        } else if (!strncmp( argv[i], "--layout=", 9 )) {
+            layout = PackLayout_COUNT;
+            for (int l=0; l < PackLayout_COUNT; l++) {
+                if (!strcmp( argv[i] + 9, g_packLayoutNames[l] )) {
+                    layout = (PackLayoutType)l;
+                }
+            }
+            if (layout == PackLayout_COUNT) {
+                printf("ERROR: Unknown layout '%s'\n", argv[i] + 9 );
+                return 1;
+            }
+            layoutSet = true;
+        } else if (!strncmp( argv[i], "--emit=", 7 )) {
+            emit = Emit_COUNT;
+            for (int e=0; e < Emit_COUNT; e++) {
+                if (!strcmp( argv[i] + 7, g_emitNames[e] )) {
+                    emit = (EmitType)e;
+                }
+            }
+            if (emit == Emit_COUNT) {
+                printf("ERROR: Unknown output type '%s'\n", argv[i] + 7 );
+                return 1;
+            }
+        } else if (!strncmp( argv[i], "--align=", 8 )) {
+            nodeAlign = atoi( argv[i] + 8 );
+            if ((nodeAlign != 8) && (nodeAlign != 16)) {
+                printf("ERROR: node alignment must be 8 or 16\n");
+                return 1;
+            }
+            formatOptions = true;
+        } else if (!strncmp( argv[i], "--label-size=", 13 )) {
+            g_labelSize = atoi( argv[i] + 13 );
+            if ((g_labelSize < 2) || (g_labelSize > 4)) {
+                printf("ERROR: label size must be 2, 3 or 4\n");
+                return 1;
+            }
+            formatOptions = true;
+        } else if (!strncmp( argv[i], "--edge-limit=", 13 )) {
+            g_edgeLimit = atoi( argv[i] + 13 );
+            if ((g_edgeLimit < 1) || (g_edgeLimit > 16)) {
+                printf("ERROR: edge limit must be 1 to 16\n");
+                return 1;
+            }
+            formatOptions = true;
+        } else if ((!strcmp( argv[i], "--tune" )) || (!strcmp( argv[i], "--tune=speed" ))) {
+            tune = Tune_Speed;
+        } else if (!strcmp( argv[i], "--tune=size" )) {
+            tune = Tune_Size;
+        } else if (!strcmp( argv[i], "--succinct" )) {
+            succinct = true;
+        } else if (!strcmp( argv[i], "--child-labels" )) {
+            childLabels = true;
+        } else if (!strcmp( argv[i], "--word-index" )) {
+            wordIndex = true;
+        } else if (!strcmp( argv[i], "--summaries" )) {
+            summaries = true;
+        } else if ((!strcmp( argv[i], "--filter" )) || (!strncmp( argv[i], "--filter=", 9 ))) {
+            filterBits = argv[i][8] ? atoi( argv[i] + 9 ) : 10;
+            if ((filterBits < 2) || (filterBits > 32)) {
+                printf("ERROR: filter bits per word must be 2 to 32\n");
+                return 1;
+            }
+        } else if (!strcmp( argv[i], "--sorted" )) {
+            sortedInput = true;
+        } else if (!strcmp( argv[i], "--fold-case" )) {
+            wordOptions.foldCase = true;
+        } else if (!strcmp( argv[i], "--qu-as-q" )) {
+            wordOptions.quAsQ = true;
+        } else if (!strncmp( argv[i], "-j", 2 )) {
+            const char *arg = argv[i] + 2;
+            if ((!*arg) && (i+1 < argc)) {
+                arg = argv[++i];
+            }
+            numThreads = atoi( arg );
+            if (numThreads <= 0) {
+                numThreads = (int)std::thread::hardware_concurrency();
+                if (numThreads <= 0) {
+                    numThreads = 1;
+                }
+            }
+        } else if (argv[i][0] == '-') {
+            printf("ERROR: Unknown option '%s'\n", argv[i] );
+            return 1;
+        } else {
+            files.push_back( argv[i] );
+        }
+    }
+
+    if (files.size() < 2) {
+        printf("Usage: wordtool [options] <wordlist.txt> [more word lists...] <wordfile.dat>\n"
+               "Options:\n"
+               "  --edge-index-size=N   use at least N (2, 3 or 4) bytes per edge index,\n"
+               "                        by default the smallest that fits is used\n"
+               "  --layout=NAME         node order in the packed data, one of:\n"
+               "                          dfs      depth first (default)\n"
+               "                          bfs      level order, top levels stay in cache\n"
+               "                          veb      van Emde Boas style recursive blocks\n"
+               "                          cluster  depth first, padded so children share a cache line\n"
+               "  --align=N             pad nodes to N (8 or 16) bytes and align the edge indices,\n"
+               "                        bigger but faster than the default packed nodes (8 only\n"
+               "                        fits 2 byte indices, lists that need 4 must use 16)\n"
+               "  --label-size=N        chars per node label (2, 3 or 4, default 4)\n"
+               "  --edge-limit=N        edges stored in a packed node (default %d), nodes with\n"
+               "                        more use up the nodes after them\n"
+               "  --tune[=GOAL]         try the label sizes, edge limits and alignments on these\n"
+               "                        words, print the size and lookup speed of each and use\n"
+               "                        the best. GOAL is speed (default, the smallest of the ones\n"
+               "                        within 10%% of the fastest) or size\n"
+               "  --succinct            store the nodes in a few bits each instead of packed structs,\n"
+               "                        about half the size but lookups are a few times slower\n"
+               "  --child-labels        store a copy of the children's labels in each node, so\n"
+               "                        lookups don't have to touch children they don't follow\n"
+               "  --word-index          store word counts so WordList_IndexOf and WordList_WordAt\n"
+               "                        work, this adds 4 bytes per node\n"
+               "  --summaries           store what's below each node so pattern and rack searches\n"
+               "                        can skip more, this adds 8 bytes per node\n"
+               "  --filter[=BITS]       add a Bloom filter of the words with BITS (default 10) bits\n"
+               "                        per word, so WordList_ContainsFiltered can turn away most\n"
+               "                        words that aren't in the list without reading the nodes\n"
+               "  --sorted              the word lists are sorted, build the packed DAG as the words\n"
+               "                        are read instead of building the whole trie first. Uses\n"
+               "                        much less memory for big lists\n"
+               "  -j N                  build on N threads (0 for one per core), the words are\n"
+               "                        split up by their first letter\n"
+               "  --fold-case           make all the words lower case\n"
+               "  --qu-as-q             replace \"qu\" with \"q\", for games with a Qu tile\n"
+               "  --emit=TYPE           what to write, one of:\n"
+               "                          dat        the data file (default)\n"
+               "                          c          C source with the data in a const array\n"
+               "                          constexpr  C++17 header for tk::WordList at compile time\n"
+               "                          incbin     the data file and an assembler file (.S)\n"
+               "                                     that includes it with .incbin\n"
+               "                        the array is named after the output file\n"
+               "\n"
+               "Each line of the word list is a word, optionally followed by a space or tab and\n"
+               "a weight (e.g. a frequency count). If any word has a weight, the weights are\n"
+               "stored for ranking autocomplete results. A %% after a word is ignored. If there\n"
+               "is more than one word list they're merged, and words that are in the lists more\n"
+               "than once are only stored once, with the biggest weight. Words with %d or more\n"
+               "letters, or a '*', '%%' or whitespace in them, are skipped.\n", EDGE_LIMIT, MAX_WORD_LENGTH-1 );
+        return 1;
+    }
+    if (sortedInput && (numThreads > 1)) {
+        printf("ERROR: -j doesn't work with --sorted\n");
+        return 1;
+    }
+    if ((emit == Emit_Constexpr) && childLabels) {
+        printf("ERROR: tk::WordList can't read --child-labels, so they don't work with --emit=constexpr\n");
+        return 1;
+    }
+    if ((emit == Emit_Constexpr) && (g_labelSize != 4)) {
+        printf("ERROR: tk::WordList only reads 4 char labels, so --label-size doesn't work with --emit=constexpr\n");
+        return 1;
+    }
+    if (tune && sortedInput) {
+        printf("ERROR: --tune needs all the words at once, so it doesn't work with --sorted\n");
+        return 1;
+    }
+    if (tune && formatOptions) {
+        printf("ERROR: --tune picks the label size, edge limit and alignment itself\n");
+        return 1;
+    }
+    if (succinct && (tune || nodeAlign || childLabels || layoutSet || (minEdgeIndexSize != 2) ||
+                     (g_edgeLimit != EDGE_LIMIT))) {
+        printf("ERROR: --succinct nodes have no edge indices or layout, only --label-size works with it\n");
+        return 1;
+    }
+    if ((emit == Emit_Constexpr) && succinct) {
+        printf("ERROR: tk::WordList can't read --succinct nodes, so they don't work with --emit=constexpr\n");
+        return 1;
+    }
+    
+    // The last file is the output, the rest are merged together
+    int numWordLists = (int)files.size() - 1;
+    const char *wordDataFile = files.back();
+
+    TrieNode *root = NULL;
+    SortedBuilder *sortedBuilder = NULL;
+    std::vector<BuildShard*> shards;
+    if (sortedInput) {
+        sortedBuilder = new SortedBuilder();
+    } else if (numThreads == 1) {
+        root = TrieNode_Alloc( "", 0 );
+    }
+    
+    int count = 0;
+    int rawsize = 0;
+
+#if 0
+    // TrieNode_Insert( root, (char *)"team" );
+    // TrieNode_Insert( root, (char *)"test" );
+    // TrieNode_Insert( root, (char *)"teams" );
+    // TrieNode_Insert( root, (char *)"aardvark" );
+    // TrieNode_Insert( root, (char *)"aardwulf" );
+    TrieNode_Insert( root, (char *)"zoo" );
+    TrieNode_Insert( root, (char *)"zoos" );
+    TrieNode_Insert( root, (char *)"zookeeper" );
+    TrieNode_Insert( root, (char *)"zookeepers" );
+
+    TrieNode_Insert( root, (char *)"cling" );
+    TrieNode_Insert( root, (char *)"clinger" );
+    TrieNode_Insert( root, (char *)"clings" );
+    
+    TrieNode_Insert( root, (char *)"claw" );
+
+    TrieNode_Insert( root, (char *)"zinger" );
+    TrieNode_Insert( root, (char *)"zings" );
+    TrieNode_Insert( root, (char *)"zing" );
+
+    TrieNode_Insert( root, (char *)"troubadour" );
+
+    TrieNode_Insert( root, (char *)"bank" );
     TrieNode_Insert( root, (char *)"bing" );
     TrieNode_Insert( root, (char *)"bings" );
     TrieNode_Insert( root, (char *)"binge" );
@@ -639,53 +2263,97 @@ int main( int argc, char *argv[] )
     
     int wlCount[MAX_WORD_LENGTH] = {};
 
-    // Read the word list
-    FILE *fp = fopen( wordList, "rt");
-    if (!fp) {
-    	printf("ERROR Could not open word list '%s'\n", wordList );
-    	return 1;
+    // Read the word lists
+    std::chrono::steady_clock::time_point readStart = std::chrono::steady_clock::now();
+    std::vector<WordReader> readers( numWordLists );
+    for (int i=0; i < numWordLists; i++) {
+        if (!WordReader_Open( &readers[i], files[i], wordOptions )) {
+            printf("ERROR Could not open word list '%s'\n", files[i] );
+            return 1;
+        }
     }
 
+    Arena wordArena = {};
+    std::vector<WordEntry> words;
+    if (sortedBuilder) {
+        // Merge the sorted lists as they're read, the builder checks they're in order
+        std::vector<WordEntry> next( numWordLists );
+        std::vector<char> nextWords( numWordLists * MAX_WORD_LENGTH );
+        for (int i=0; i < numWordLists; i++) {
+            int len = 0;
+            next[i].word = &nextWords[i * MAX_WORD_LENGTH];
+            next[i].len = WordReader_Next( &readers[i], (char*)next[i].word, &len, &next[i].weight ) ? (uint8_t)len : 0;
+            next[i].sortKey = WordSortKey( next[i].word, next[i].len );
+        }
+        while (1) {
+            int best = -1;
+            for (int i=0; i < numWordLists; i++) {
+                if (next[i].len && ((best < 0) || WordEntryLess( next[i], next[best] ))) {
+                    best = i;
+                }
+            }
+            if (best < 0) {
+                break;
+            }
+            bool repeat = (sortedBuilder->wordLen == next[best].len + 1) &&
+                          (!memcmp( sortedBuilder->word, next[best].word, next[best].len ));
+            if (!SortedBuilder_Add( sortedBuilder, next[best].word, next[best].weight )) {
+                printf("ERROR Word list isn't sorted, '%s' in %s is out of order\n", next[best].word, files[best] );
+                return 1;
+            }
+            if (!repeat) {
+                wlCount[ next[best].len ]++;
+                count++;
+                rawsize += next[best].len + 1;
+            }
+            int len = 0;
+            next[best].len = WordReader_Next( &readers[best], (char*)next[best].word, &len, &next[best].weight ) ? (uint8_t)len : 0;
+            next[best].sortKey = WordSortKey( next[best].word, next[best].len );
+        }
+    } else {
+        ReadAllWords( readers, &wordArena, words );
+        for (size_t i=0; i < words.size(); i++) {
+            wlCount[ words[i].len ]++;
+            count++;
+            rawsize += words[i].len + 1;
+        }
+    }
 
-    char line[1024];
-    while (!feof(fp)) {
-    	fgets( line, 1024, fp );
-    	
-
-    	// Strip CR and newlines, also strip % which the word list
-    	// uses to indicate plurals
-    	char *ch = line + strlen(line)-1;
-    	while ((ch > line) && ((*ch=='\n') || (*ch=='\r') || (*ch=='%') ) ) {
-    		*ch = '\0';
-    		ch--;
-    	}
-
-    	
-    	int len = strlen(line);
-    	if (len >= MAX_WORD_LENGTH) {
-    		printf("Word '%s' len %d, max %d\n", line, len, MAX_WORD_LENGTH );
-    		return 1;
-    	}
-    	wlCount[len]++;
-
-    	// TODO: sanitize words, eg. replace Qu with Q
-
-    	TrieNode_Insert( root, line );
+    size_t numLines = 0;
+    size_t numSkipped = 0;
+    bool hasWeights = false;
+    for (int i=0; i < numWordLists; i++) {
+        numLines += readers[i].numLines;
+        numSkipped += readers[i].numSkipped;
+        hasWeights = hasWeights || readers[i].hasWeights;
+    }
+    printf("Read %zu lines from %d word list%s in %.2fs, %d different words, skipped %zu that were too long or couldn't be packed.\n",
+           numLines, numWordLists, (numWordLists == 1) ? "" : "s",
+           std::chrono::duration<double>( std::chrono::steady_clock::now() - readStart ).count(),
+           count, numSkipped );
 
-    	count++;
-        rawsize += strlen(line) + 1;
+    if (tune) {
+        TuneFormat( words, tune, (emit == Emit_Constexpr) ? 4 : 2, minEdgeIndexSize, childLabels, layout, &nodeAlign );
+    }
 
-//        if (count==1000) {
-//            break;
-//        }
+    if (numThreads > 1) {
+        root = BuildShards( words, numThreads, shards );
+    } else if (!sortedBuilder) {
+        for (size_t i=0; i < words.size(); i++) {
+            TrieNode *leaf = TrieNode_Insert( root, (char*)words[i].word );
+            leaf->weight = words[i].weight;
+        }
+        TrieNode_SplitLongNodes( root, g_labelSize );
+        TrieNode_NormalizeEdges( root );
+    }
+    std::vector<WordEntry>().swap( words );
+    Arena_Release( &wordArena );
+    for (int i=0; i < numWordLists; i++) {
+        WordReader_Close( &readers[i] );
     }
-	
-    TrieNode_SplitLongNodes( root, 4 );
-    TrieNode_NormalizeEdges( root );
-    TrieNode_UpdateHash( root );
 
 //    TrieNode_Print( root, 0 );
-    printf("%d nodes total...\n", g_nodeCount );
+    printf("%d nodes total...\n", g_nodeCount.load() );
 //    printf("-------\n");
 //    //TrieNode_WordList( root, "" );
     
@@ -697,24 +2365,16 @@ int main( int argc, char *argv[] )
     }
 #endif
     
-    uint32_t counter = 1;
-    TrieNode_Label( root, &counter );
-    
-    CountTableEntry ** countTable = (CountTableEntry**)malloc(sizeof(CountTableEntry*)*HASHTABLESIZE );
-    memset( countTable, 0, sizeof(CountTableEntry*)*HASHTABLESIZE );
-    
-    for (int i=0; i < 5000; i++)
-    {
-        //TrieNode *mostDupes = TrieNode_FindMostDuplicated( root, root );
-        TrieNode *mostDupes = TrieNode_FindMostDuplicated2( countTable, root );
-        printf("FindMostDupes iter %d: %d(%s), count %d\n", 
-            i, mostDupes->nodeId, mostDupes->label, mostDupes->dupeCount);
-        if (mostDupes->dupeCount <= 1) {
-            break;
-        }
-        
-        int result = TrieNode_ReplaceSubtree( root, mostDupes );
-        //printf("Replace dupes result %d\n", result );
+    if (sortedBuilder) {
+        // Already deduped as it went
+        root = SortedBuilder_Finish( sortedBuilder );
+        printf("%zu unique nodes built from sorted input.\n", sortedBuilder->table.count + 1 );
+        delete sortedBuilder;
+    } else {
+        // Collapse the duplicate subtrees, for shards this is just the ones they share
+        NodeTable nodeTable = {};
+        root = TrieNode_Dedupe( root, &nodeTable, (numThreads > 1) ? 2 : 1 );
+        printf("%zu unique nodes after merging duplicate subtrees.\n", nodeTable.count );
     }
     
 #if DEBUG_GRAPH
@@ -751,22 +2411,123 @@ int main( int argc, char *argv[] )
         }
     }
     
-    // Pack word data
-    WordListNode *worddata = (WordListNode*)malloc(WORDBUFFSZ);
-    memset( worddata, 0, WORDBUFFSZ );
-    root->packNode = worddata;
-    _baseNode = worddata;
-    WordListNode *nextPackNode = worddata;
-    nextPackNode += calcNumPackNodes(root->numEdges);
-    PackWordList( root, worddata, &nextPackNode );
-    //printf("After packWordList, nextPackNode is %d\n", nextPackNode - worddata );
-    int numPackNodes = 0;
-    AssignWordlistIndices( worddata, root, &numPackNodes );
+    // Pack word data, using the smallest edge index that can reach every node
+    WordListFormat format = {};
+    uint32_t numPackNodes;
+    std::vector<uint8_t> succinctData;
+    if (succinct) {
+        format.labelSize = g_labelSize;
+        format.succinct = 1;
+        numPackNodes = PackSuccinct( root, succinctData );
+        printf("Using succinct nodes with %d char labels, %.1f bits per node.\n",
+               format.labelSize, succinctData.size() * 8.0 / numPackNodes );
+    } else {
+        numPackNodes = PackSmallestFormat( root, minEdgeIndexSize, nodeAlign, childLabels, layout, &format );
+        if (!numPackNodes) {
+            printf("ERROR: %d byte nodes don't have room for a 4 byte edge index after a %d char label,\n"
+                   "this list needs --align=16\n", nodeAlign, g_labelSize );
+            return 1;
+        }
+        printf("Using %d byte edge indices, %d char labels, %d byte %s nodes%s.\n", format.edgeIndexSize,
+               format.labelSize, format.nodeSize, nodeAlign ? "aligned" : "packed", childLabels ? " with child labels" : "" );
+
+        // Compare the layouts, then redo the one we're using
+        for (int i=0; i < PackLayout_COUNT; i++) {
+            PackLayout( root, format, (PackLayoutType)i );
+            printf("Layout %-8s %5.2f cache lines per lookup%s\n", g_packLayoutNames[i],
+                   AverageCacheLinesPerLookup( root, format, sizeof(WordListHeader) ),
+                   (i == layout) ? " <-- using this" : "" );
+        }
+        PackLayout( root, format, layout );
+    }
+
+    uint32_t numWords = root->numEdges ? TrieNode_CountWords( root ) : 0;
+    WordListHeader header = MakePackHeader( format, numPackNodes, numWords, nodeAlign );
+
+    // The nodes, then the optional sections, each 4 byte aligned
+    size_t packSize = succinct ? succinctData.size() : (size_t)numPackNodes * format.nodeSize;
+    if (succinct) {
+        header.nodesSize = (uint32_t)packSize;
+    }
+    size_t fileSize = sizeof(WordListHeader) + packSize;
+    size_t sectionSize = (size_t)numPackNodes * sizeof(uint32_t);
+    if (hasWeights) {
+        header.weightsOffset = (uint32_t)((fileSize + 3) & ~3);
+        fileSize = header.weightsOffset + sectionSize;
+    }
+    if (wordIndex) {
+        header.countsOffset = (uint32_t)((fileSize + 3) & ~3);
+        fileSize = header.countsOffset + sectionSize;
+    }
+    if (summaries) {
+        header.lengthsOffset = (uint32_t)((fileSize + 3) & ~3);
+        fileSize = header.lengthsOffset + sectionSize;
+        header.lettersOffset = (uint32_t)fileSize;
+        fileSize = header.lettersOffset + sectionSize;
+    }
+    uint32_t filterBlocks = 0;
+    if (filterBits) {
+        // Cache line aligned, the file is mapped on a page boundary
+        filterBlocks = (uint32_t)(((uint64_t)header.numWords * filterBits + WORDLIST_FILTER_BLOCK_SIZE*8 - 1) /
+                                  (WORDLIST_FILTER_BLOCK_SIZE*8));
+        if (filterBlocks == 0) {
+            // An empty list still needs a block for the runtime to test against
+            filterBlocks = 1;
+        }
+        header.filterOffset = (uint32_t)((fileSize + WORDLIST_FILTER_BLOCK_SIZE - 1) & ~(size_t)(WORDLIST_FILTER_BLOCK_SIZE - 1));
+        header.filterSize = filterBlocks * WORDLIST_FILTER_BLOCK_SIZE;
+        fileSize = header.filterOffset + header.filterSize;
+    }
+    header.fileSize = (uint32_t)fileSize;
+
+    uint8_t *fileData = (uint8_t*)malloc( fileSize );
+    memset( fileData, 0, fileSize );
+    uint8_t *packData = fileData + sizeof(WordListHeader);
+    if (succinct) {
+        memcpy( packData, succinctData.data(), packSize );
+    } else {
+        PackWordList( root, packData, format );
+    }
+    if (hasWeights) {
+        TrieNode_UpdateMaxWeight( root );
+        PackNodeSection( root, fileData + header.weightsOffset, NodeMaxWeight );
+    }
+    if (wordIndex) {
+        PackNodeSection( root, fileData + header.countsOffset, NodeWordCount );
+    }
+    if (summaries) {
+        TrieNode_UpdateLengths( root );
+        PackNodeSection( root, fileData + header.lengthsOffset, NodeLengths );
+        TrieNode_UpdateLetters( root );
+        PackNodeSection( root, fileData + header.lettersOffset, NodeLetters );
+    }
+    if (filterBits) {
+        // Add the words as they were packed, after any case folding
+        WordList packed;
+        memcpy( fileData, &header, sizeof(WordListHeader) );
+        if (!WordList_OpenMemory( &packed, fileData, fileSize )) {
+            printf("ERROR Packed data is broken: %s\n", packed.error );
+            return 1;
+        }
+        WordList_Enumerator enumerator = WordList_MakeListEnumerator( &packed );
+        char *word;
+        while ((word = WordList_NextWord( &enumerator ))) {
+            WordList_FilterAdd( fileData + header.filterOffset, filterBlocks, word, strlen( word ) );
+        }
+    }
+
+    header.dataChecksum = WordList_Checksum( packData, fileSize - sizeof(WordListHeader) );
+    memcpy( fileData, &header, sizeof(WordListHeader) );
     
     int indexSize = sizeof(uint32_t) * count;
     printf("\n\nPacked %d Words (%d bytes), %d packNodes, %zu bytes.\n",
-           count, rawsize + indexSize,
-           numPackNodes, numPackNodes * sizeof(WordListNode));
+           count, rawsize + indexSize, numPackNodes, packSize );
+
+    WordList wordlist;
+    if (!WordList_OpenMemory( &wordlist, fileData, fileSize )) {
+        printf("ERROR Packed data is broken: %s\n", wordlist.error );
+        return 1;
+    }
 
     // Test it
     const char *testWords[] = {
@@ -774,14 +2535,96 @@ int main( int argc, char *argv[] )
         "zzyzhags", "blarg", "teams", "troubadour",
     };
     for (int i=0; i < sizeof(testWords) / sizeof(testWords[0]); i++ ) {
-        int result = WordList_Lookup( worddata, (char *)testWords[i] );
+        int result = WordList_Contains( &wordlist, testWords[i] );
         printf("%20s ... %s\n", testWords[i], result?"FOUND":"Not Found" );
     }
+    WordList_Completion completions[5];
+    int numCompletions = WordList_Complete( &wordlist, "tea", completions, 5 );
+    printf("%20s ...", "tea" );
+    for (int i=0; i < numCompletions; i++) {
+        printf(" %s(%u)", completions[i].word, completions[i].weight );
+    }
+    printf("\n");
+    if (wordIndex && header.numWords) {
+        // Round trip the middle word, the index comes back smaller if it's in the list twice
+        char indexWord[MAX_WORD_LENGTH];
+        char checkWord[MAX_WORD_LENGTH];
+        uint32_t index = header.numWords / 2;
+        int checkIndex = -1;
+        if (WordList_WordAt( &wordlist, index, indexWord )) {
+            checkIndex = WordList_IndexOf( &wordlist, indexWord );
+        }
+        if ((checkIndex < 0) || ((uint32_t)checkIndex > index) ||
+            (!WordList_WordAt( &wordlist, checkIndex, checkWord )) || strcmp( indexWord, checkWord )) {
+            printf("ERROR Word index is broken\n");
+            return 1;
+        }
+        printf("%20s ... index %u\n", indexWord, index );
+    }
+    if (filterBits) {
+        // Every word has to get through, and see how many changed words do
+        uint32_t numMissed = 0;
+        uint32_t numProbes = 0;
+        uint32_t numPassed = 0;
+        WordList_Enumerator enumerator = WordList_MakeListEnumerator( &wordlist );
+        char *word;
+        while ((word = WordList_NextWord( &enumerator ))) {
+            size_t len = strlen( word );
+            numMissed += !WordList_FilterTest( wordlist.filter, wordlist.filterBlocks, word, len );
+            char probe[MAX_WORD_LENGTH];
+            memcpy( probe, word, len + 1 );
+            probe[len-1] = (probe[len-1] == 'z') ? 'a' : probe[len-1] + 1;
+            if (!WordList_Contains( &wordlist, probe )) {
+                numProbes++;
+                numPassed += WordList_FilterTest( wordlist.filter, wordlist.filterBlocks, probe, len );
+            }
+        }
+        if (numMissed) {
+            printf("ERROR Prefilter is broken, it turns away %u words\n", numMissed );
+            return 1;
+        }
+        printf("Prefilter is %u bytes (%d bits per word), %.2f%% of %u changed words get through.\n",
+               header.filterSize, filterBits, numProbes ? 100.0 * numPassed / numProbes : 0.0, numProbes );
+    }
 
     // Write output file
-    FILE *fpDatafile = fopen( wordDataFile, "wb" );
-    size_t result = fwrite( worddata, sizeof(WordListNode), numPackNodes, fpDatafile );
-    fclose( fpDatafile);
-    printf("Wrote %zu bytes to %s .\n", result*sizeof(WordListNode), wordDataFile );
+    std::string embedName = EmbedName( wordDataFile );
+    bool written = false;
+    if (emit == Emit_C) {
+        written = WriteCSource( wordDataFile, embedName, fileData, fileSize );
+    } else if (emit == Emit_Constexpr) {
+        written = WriteConstexprHeader( wordDataFile, embedName, WordListTypeName( format, nodeAlign ), fileData, fileSize );
+    } else {
+        written = WriteDataFile( wordDataFile, fileData, fileSize );
+    }
+    if (!written) {
+        printf("ERROR Could not write data file '%s'\n", wordDataFile );
+        return 1;
+    }
+    if (emit == Emit_Incbin) {
+        std::string asmFile = std::string( wordDataFile ) + ".S";
+        if (!WriteIncbinSource( asmFile.c_str(), embedName, wordDataFile )) {
+            printf("ERROR Could not write '%s'\n", asmFile.c_str() );
+            return 1;
+        }
+        printf("Wrote %s to build in as '%s'.\n", asmFile.c_str(), embedName.c_str() );
+    } else if (emit != Emit_Data) {
+        printf("Array is named '%s'.\n", embedName.c_str() );
+    }
+    printf("Wrote %zu bytes (%u words) to %s .\n", fileSize, header.numWords, wordDataFile );
 
+    size_t trieBytes = g_arena.bytesUsed;
+    for (size_t i=0; i < shards.size(); i++) {
+        trieBytes += shards[i]->arena.bytesUsed;
+    }
+    printf("Trie used %.2f MB for %d nodes, peak memory %.2f MB.\n",
+           (double)trieBytes / MEGABYTE, g_nodeCount.load(), (double)PeakMemoryBytes() / MEGABYTE );
+    WordList_Close( &wordlist );
+    free( fileData );
+    for (size_t i=0; i < shards.size(); i++) {
+        Arena_Release( &shards[i]->arena );
+        delete shards[i];
+    }
+    Arena_Release( &g_arena );
+    return 0;
 }